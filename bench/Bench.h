@@ -0,0 +1,62 @@
+#pragma once
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <stdint.h>
+
+// Exact cycle counts of the firmware running under simavr, read by
+// tools/avrbench.
+//
+// The firmware only writes GPIOR0, a general purpose I/O register nothing
+// else uses. The runner sees every write and notes the cycle counter of the
+// simulated CPU, so whatever runs between START and STOP is counted to the
+// cycle. Before START, GPIOR1 (low byte) and GPIOR2 (high byte) hold the
+// address of the benchmark's name, a PROGMEM string.
+namespace bench {
+
+enum class Mark : uint8_t {
+	STOP = 0,
+	START = 1,
+	// Every benchmark ran, the runner stops the simulation
+	DONE = 2,
+};
+
+inline auto mark(Mark m) -> void {
+	// Nothing moves across a mark, only the code under test is counted
+	asm volatile("" ::: "memory");
+	GPIOR0 = static_cast<uint8_t>(m);
+	asm volatile("" ::: "memory");
+}
+
+// Counts fn() with interrupts off, so a Timer0 tick that lands inside one
+// run and not the next does not show up as a change
+template <class Fn>
+auto measure(PGM_P name, Fn fn) -> void {
+	auto const address = reinterpret_cast<uintptr_t>(name);
+	GPIOR1 = static_cast<uint8_t>(address);
+	GPIOR2 = static_cast<uint8_t>(address >> 8);
+
+	auto const sreg = SREG;
+	cli();
+	mark(Mark::START);
+	fn();
+	mark(Mark::STOP);
+	SREG = sreg;
+}
+
+// What the marks themselves cost, the runner takes it off every other count.
+// Goes first.
+inline auto calibrate() -> void { measure(PSTR("(empty)"), [] {}); }
+
+// Sleeping with interrupts off is how a program ends under simavr
+[[noreturn]] inline auto done() -> void {
+	mark(Mark::DONE);
+	cli();
+	sleep_enable();
+	for (;;)
+		sleep_cpu();
+}
+
+}  // namespace bench
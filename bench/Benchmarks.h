@@ -0,0 +1,179 @@
+#pragma once
+
+// The benchmarks `make bench` runs, included at the end of main.cpp in the
+// bench build so it can use the plant's globals. Each has a name the
+// baseline knows it by: renaming one makes it new, changing what it does
+// means recording the baseline again.
+//
+// The state machines under test have their own pins and lines, so what they
+// are put through does not depend on the plant or on what simavr has on the
+// pins. The main loop passes are the plant itself.
+
+#include <stdint.h>
+#include "Arbiter.h"
+#include "Bench.h"
+#include "Clock.h"
+#include "InputDebouncer.h"
+#include "Log.h"
+#include "NextionUtils.h"
+#include "Switch.h"
+#include "TankSM.h"
+#include "UiSm.h"
+
+namespace bench {
+
+using kev::Switch;
+
+// Empties the log buffer between benchmarks, so none of them pays for
+// making room in a full one
+struct LogSink {
+	auto availableForWrite() -> int { return 256; }
+	auto write(uint8_t const*, size_t n) -> size_t { return n; }
+};
+
+// The display end of the UART: what the firmware sends is dropped and every
+// command gets a success reply, as the display does with bkcmd=3
+struct Display : Print {
+	auto write(uint8_t b) -> size_t override {
+		ends = b == 0xFF ? ends + 1 : 0;
+		if (ends == 3) {
+			ends = 0;
+			receive(ACK, sizeof(ACK));
+		}
+		return 1;
+	}
+
+	using Print::write;
+
+	// Queues bytes as if the display had sent them
+	auto receive(uint8_t const* bytes, uint8_t n) -> void {
+		if (at == size)
+			at = size = 0;
+		for (uint8_t i = 0; i < n && size < sizeof(rx); ++i)
+			rx[size++] = bytes[i];
+	}
+
+	auto available() -> int { return size - at; }
+	auto read() -> int { return at < size ? rx[at++] : -1; }
+	auto begin(unsigned long) -> void {}
+	auto flush() -> void {}
+
+   private:
+	static constexpr uint8_t ACK[] = {0x01, 0xFF, 0xFF, 0xFF};
+
+	uint8_t rx[64] = {};
+	uint8_t size = 0;
+	uint8_t at = 0;
+	// 0xFF in a row, the third ends a command
+	uint8_t ends = 0;
+};
+
+// The display is on the status page
+constexpr uint8_t PAGE_STATUS[] = {0x66, 0x03, 0xFF, 0xFF, 0xFF};
+// A press on page 3 that no button handles, what receiving a touch costs
+// before any action
+constexpr uint8_t TOUCH[] = {0x65, 0x03, 0x09, 0x01, 0xFF, 0xFF, 0xFF};
+
+// TankSM::tick in each state, in TankState order
+constexpr char const tick_names[][40] PROGMEM = {
+	"TankSM::tick INITIAL",
+	"TankSM::tick PRE_FILL",
+	"TankSM::tick FILLING",
+	"TankSM::tick WAITING_CHEM_1",
+	"TankSM::tick CHEM_1",
+	"TankSM::tick WAITING_CHEM_2",
+	"TankSM::tick CHEM_2",
+	"TankSM::tick WAITING_IN_PROCESS",
+	"TankSM::tick IN_PROCESS",
+};
+static_assert(sizeof(tick_names) / sizeof(tick_names[0]) ==
+				  static_cast<uint8_t>(TankState::LAST),
+			  "One name per tank state");
+
+auto log_sink = LogSink{};
+
+// Inputs of their own on port K, where the plant has none
+auto inputs = kev::InputDebouncer{5_s};
+auto input = kev::DebouncedInput{inputs, 62, true};
+
+auto tank_fill_pump = Switch{};
+auto tank_recir_pump = Switch{};
+auto tank_ingress_valve = Switch{};
+auto tank_process_valve = Switch{};
+auto tank_fill_line = kev::Arbiter{};
+auto tank_in_process_line = kev::Arbiter{};
+auto tank = TankSM{
+	TOK("bench_tank"),
+	tank_fill_pump,
+	tank_recir_pump,
+	tank_ingress_valve,
+	tank_process_valve,
+	kev::DebouncedInput{inputs, 63, true},
+	kev::DebouncedInput{inputs, 64, true},
+	tank_fill_line.handle(0),
+	tank_in_process_line.handle(0),
+};
+
+auto display = Display{};
+auto status_ui = UiSm<decltype(::tanks), decltype(::aqueduct_sm), Display>{
+	display, ::tanks, ::aqueduct_sm};
+auto parser = NextionParser<>{};
+
+auto settle() -> void { kev::log_buffer.drain(log_sink); }
+
+}  // namespace bench
+
+auto run_benchmarks() -> void {
+	using bench::measure;
+	using bench::settle;
+
+	bench::calibrate();
+
+	// Every task is due on the first pass
+	settle();
+	measure(PSTR("main loop pass, first"), [] { loop_pass(); });
+	settle();
+	measure(PSTR("main loop pass, next"), [] { loop_pass(); });
+
+	// The clock stands still from here on, every benchmark gets the same now
+	auto const now = kev::Clock::now();
+
+	// What the Timer0 interrupt costs on most ticks, and on the one that
+	// samples the plant's sensors
+	settle();
+	measure(PSTR("InputDebouncer::tick, no sample"),
+			[] { bench::inputs.tick(); });
+	settle();
+	measure(PSTR("InputDebouncer::sample, plant"), [] { ::sensors.sample(); });
+	settle();
+	measure(PSTR("DebouncedInput::update"), [] { bench::input.update(); });
+
+	for (uint8_t s = 0; s < static_cast<uint8_t>(TankState::LAST); ++s) {
+		bench::tank.resume(TankSnapshot{s, 0}, now);
+		settle();
+		measure(bench::tick_names[s], [now] { bench::tank.tick(now); });
+	}
+
+	bench::display.receive(bench::PAGE_STATUS, sizeof(bench::PAGE_STATUS));
+	bench::status_ui.tick(now);
+	settle();
+	measure(PSTR("UiSm::update_status, all changed"),
+			[now] { bench::status_ui.refresh(now); });
+	// Takes the replies
+	bench::status_ui.tick(now);
+	settle();
+	measure(PSTR("UiSm::update_status, unchanged"),
+			[now] { bench::status_ui.refresh(now); });
+
+	bench::display.receive(bench::TOUCH, sizeof(bench::TOUCH));
+	settle();
+	measure(PSTR("UiSm::tick, touch frame"),
+			[now] { bench::status_ui.tick(now); });
+	settle();
+	measure(PSTR("NextionParser::feed, touch frame"), [] {
+		for (auto const b : bench::TOUCH)
+			bench::parser.feed(b);
+	});
+
+	bench::done();
+}
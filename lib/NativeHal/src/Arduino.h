@@ -0,0 +1,72 @@
+#pragma once
+// Native stand-in for the subset of the Arduino AVR core used by the firmware
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "avr/pgmspace.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define LED_BUILTIN 13
+
+#define _BV(bit) (1 << (bit))
+
+// Timer0 registers used to enable the compare A interrupt
+inline uint8_t OCR0A = 0;
+inline uint8_t TIMSK0 = 0;
+#define OCIE0A 1
+
+// EEPROM control register, only the ready interrupt enable is used
+inline uint8_t EECR = 0;
+#define EERIE 3
+
+// Status register, saved and restored around cli()
+inline uint8_t SREG = 0;
+
+auto millis() -> unsigned long;
+auto micros() -> unsigned long;
+auto delay(unsigned long ms) -> void;
+auto delayMicroseconds(unsigned int us) -> void;
+
+auto pinMode(uint8_t pin, uint8_t mode) -> void;
+auto digitalWrite(uint8_t pin, uint8_t val) -> void;
+auto digitalRead(uint8_t pin) -> int;
+
+// Ports are 8 consecutive pins here, not the Mega's layout, which only code
+// going through these can tell
+namespace native {
+
+// A PORTx or PINx register for code that reads or stores whole ports, made
+// of the levels of its 8 pins
+struct PortRegister {
+	operator uint8_t() const;
+	auto operator=(uint8_t value) -> PortRegister&;
+
+	uint8_t port;
+};
+
+}  // namespace native
+
+inline auto digitalPinToPort(uint8_t pin) -> uint8_t { return pin / 8 + 1; }
+inline auto digitalPinToBitMask(uint8_t pin) -> uint8_t {
+	return static_cast<uint8_t>(1u << pin % 8);
+}
+auto portOutputRegister(uint8_t port) -> native::PortRegister*;
+inline auto portInputRegister(uint8_t port) -> native::PortRegister* {
+	return portOutputRegister(port);
+}
+
+auto init() -> void;
+
+#include "HardwareSerial.h"
+#include "WString.h"
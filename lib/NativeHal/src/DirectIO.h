@@ -0,0 +1,64 @@
+#pragma once
+// Native stand-in for mmarchetti/DirectIO. Levels live in the NativeHal pin
+// table so host tools can read outputs and drive inputs.
+
+#include "Arduino.h"
+#include "NativeHal.h"
+
+template <uint8_t pin, bool pullup = true>
+class Input {
+   public:
+	Input() {
+		if (pullup)
+			native::set_pin_level(pin, HIGH);
+	}
+	auto read() -> bool { return native::pin_level(pin); }
+	operator bool() { return read(); }
+};
+
+template <uint8_t pin, bool pullup = true>
+class InputLow {
+   public:
+	InputLow() {
+		if (pullup)
+			native::set_pin_level(pin, HIGH);
+	}
+	auto read() -> bool { return !native::pin_level(pin); }
+	operator bool() { return read(); }
+};
+
+template <uint8_t pin, bool initial_state = LOW>
+class Output {
+   public:
+	Output() { write(initial_state); }
+	auto write(bool value) -> void { native::set_pin_level(pin, value); }
+	auto operator=(bool value) -> Output& {
+		write(value);
+		return *this;
+	}
+	auto toggle() -> void { write(!read()); }
+	auto pulse(bool value = HIGH) -> void {
+		write(value);
+		write(!value);
+	}
+	auto read() -> bool { return native::pin_level(pin); }
+	operator bool() { return read(); }
+};
+
+template <uint8_t pin, bool initial_state = LOW>
+class OutputLow {
+   public:
+	OutputLow() { write(initial_state); }
+	auto write(bool value) -> void { native::set_pin_level(pin, !value); }
+	auto operator=(bool value) -> OutputLow& {
+		write(value);
+		return *this;
+	}
+	auto toggle() -> void { write(!read()); }
+	auto pulse(bool value = HIGH) -> void {
+		write(value);
+		write(!value);
+	}
+	auto read() -> bool { return !native::pin_level(pin); }
+	operator bool() { return read(); }
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <deque>
+#include "NativeHal.h"
+#include "Stream.h"
+
+class HardwareSerial : public Stream {
+   public:
+	HardwareSerial() = default;
+	HardwareSerial(HardwareSerial const&) = delete;
+	auto operator=(HardwareSerial const&) -> HardwareSerial& = delete;
+
+	auto begin(unsigned long baud) -> void { this->baud = baud; }
+	auto end() -> void { baud = 0; }
+
+	auto available() -> int override { return static_cast<int>(rx.size()); }
+	auto read() -> int override;
+	auto peek() -> int override;
+	auto availableForWrite() -> int override { return 63; }
+	auto flush() -> void {}
+
+	using Print::write;
+	auto write(uint8_t b) -> size_t override { return write(&b, 1); }
+	auto write(uint8_t const* buffer, size_t size) -> size_t override;
+
+	explicit operator bool() const { return true; }
+
+   private:
+	friend auto native::set_tx_sink(HardwareSerial&, native::TxSink, void*)
+		-> void;
+	friend auto native::push_rx(HardwareSerial&, uint8_t const*, uint32_t)
+		-> void;
+
+	unsigned long baud = 0;
+	std::deque<uint8_t> rx;
+	native::TxSink tx_sink = nullptr;
+	void* tx_ctx = nullptr;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+extern void serialEventRun();
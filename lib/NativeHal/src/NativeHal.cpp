@@ -0,0 +1,438 @@
+#include "NativeHal.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "DirectIO.h"
+#include "avr/eeprom.h"
+#include "avr/interrupt.h"
+#include "avr/sleep.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+HardwareSerial Serial3;
+
+// Defined by the firmware with ISR(...), if at all
+ISR(TIMER0_COMPA_vect) __attribute__((weak));
+ISR(EE_READY_vect) __attribute__((weak));
+
+namespace {
+
+bool pins[native::PIN_COUNT];
+
+bool virtual_clock = false;
+uint64_t virtual_us = 0;
+uint64_t real_epoch_us = 0;
+
+uint8_t eeprom[E2END + 1];
+bool eeprom_loaded = false;
+char const* eeprom_path = nullptr;
+
+auto real_us() -> uint64_t {
+	timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000u +
+		   static_cast<uint64_t>(ts.tv_nsec) / 1000u;
+}
+
+auto now_us() -> uint64_t {
+	if (virtual_clock)
+		return virtual_us;
+	if (real_epoch_us == 0)
+		real_epoch_us = real_us();
+	return real_us() - real_epoch_us;
+}
+
+// Stands in for the interrupts whenever the clock has moved to another
+// millisecond since the last run. Timer0 fires once for each millisecond
+// gone by, so what counts its ticks (the input debouncer) keeps time while
+// the host was busy. The EEPROM counts as ready for one byte per run.
+auto run_isrs() -> void {
+	static auto last_ms = ~uint64_t{0};
+	static auto running = false;
+	if (running)
+		return;
+	auto const ms = now_us() / 1000u;
+	if (ms == last_ms)
+		return;
+	auto const ticks = last_ms == ~uint64_t{0} || ms < last_ms
+						   ? uint64_t{1}
+						   : ms - last_ms;
+	last_ms = ms;
+	running = true;
+	if (TIMER0_COMPA_vect && (TIMSK0 & _BV(OCIE0A))) {
+		for (auto i = uint64_t{0}; i < ticks; ++i)
+			TIMER0_COMPA_vect();
+	}
+	if (EE_READY_vect && (EECR & _BV(EERIE)))
+		EE_READY_vect();
+	running = false;
+}
+
+// Interrupts run at the first millisecond boundary on the way, so an input
+// the host just changed is seen by the tick that would have seen it. The
+// Timer0 ticks after it run on the next look at the clock.
+auto move_virtual_time(uint64_t to) -> void {
+	auto const next_tick = (virtual_us / 1000u + 1u) * 1000u;
+	if (to >= next_tick) {
+		virtual_us = next_tick;
+		run_isrs();
+	}
+	virtual_us = to;
+}
+
+auto stdout_sink(void*, uint8_t const* data, uint32_t len) -> void {
+	fwrite(data, 1, len, stdout);
+}
+
+auto eeprom_image() -> uint8_t* {
+	if (!eeprom_loaded) {
+		eeprom_loaded = true;
+		memset(eeprom, 0xFF, sizeof(eeprom));
+		if (eeprom_path) {
+			if (auto* f = fopen(eeprom_path, "rb")) {
+				auto const n = fread(eeprom, 1, sizeof(eeprom), f);
+				(void)n;
+				fclose(f);
+			}
+		}
+	}
+	return eeprom;
+}
+
+auto eeprom_flush() -> void {
+	if (!eeprom_path)
+		return;
+	if (auto* f = fopen(eeprom_path, "wb")) {
+		fwrite(eeprom, 1, sizeof(eeprom), f);
+		fclose(f);
+	}
+}
+
+auto eeprom_index(void const* addr) -> size_t {
+	return reinterpret_cast<uintptr_t>(addr) & E2END;
+}
+
+}  // namespace
+
+namespace native {
+
+auto pin_level(uint8_t pin) -> bool {
+	return pin < PIN_COUNT ? pins[pin] : false;
+}
+
+auto set_pin_level(uint8_t pin, bool level) -> void {
+	if (pin < PIN_COUNT)
+		pins[pin] = level;
+}
+
+auto use_virtual_time(uint64_t start_us) -> void {
+	virtual_clock = true;
+	virtual_us = start_us;
+}
+
+auto use_real_time() -> void {
+	virtual_clock = false;
+	real_epoch_us = real_us() - virtual_us;
+}
+
+auto virtual_time() -> bool { return virtual_clock; }
+
+auto set_time_us(uint64_t us) -> void { move_virtual_time(us); }
+
+auto advance_us(uint64_t us) -> void { move_virtual_time(virtual_us + us); }
+
+auto set_tx_sink(HardwareSerial& serial, TxSink sink, void* ctx) -> void {
+	serial.tx_sink = sink;
+	serial.tx_ctx = ctx;
+}
+
+auto push_rx(HardwareSerial& serial, uint8_t const* data, uint32_t len)
+	-> void {
+	serial.rx.insert(serial.rx.end(), data, data + len);
+}
+
+auto set_eeprom_file(char const* path) -> void {
+	eeprom_path = path;
+	eeprom_loaded = false;
+}
+
+}  // namespace native
+
+auto millis() -> unsigned long {
+	run_isrs();
+	return static_cast<unsigned long>(now_us() / 1000u);
+}
+
+auto micros() -> unsigned long {
+	run_isrs();
+	return static_cast<unsigned long>(now_us());
+}
+
+auto delay(unsigned long ms) -> void {
+	if (virtual_clock) {
+		move_virtual_time(virtual_us + ms * 1000u);
+		return;
+	}
+	usleep(static_cast<useconds_t>(ms * 1000u));
+}
+
+auto delayMicroseconds(unsigned int us) -> void {
+	if (virtual_clock) {
+		move_virtual_time(virtual_us + us);
+		return;
+	}
+	usleep(us);
+}
+
+auto sleep_cpu() -> void {
+	if (virtual_clock) {
+		move_virtual_time((virtual_us / 1000u + 1u) * 1000u);
+		return;
+	}
+	usleep(static_cast<useconds_t>(1000u - now_us() % 1000u));
+	serialEventRun();
+}
+
+auto pinMode(uint8_t pin, uint8_t mode) -> void {
+	if (mode == INPUT_PULLUP)
+		native::set_pin_level(pin, HIGH);
+}
+
+auto digitalWrite(uint8_t pin, uint8_t val) -> void {
+	native::set_pin_level(pin, val != LOW);
+}
+
+auto digitalRead(uint8_t pin) -> int {
+	return native::pin_level(pin) ? HIGH : LOW;
+}
+
+native::PortRegister::operator uint8_t() const {
+	auto value = 0u;
+	for (uint8_t bit = 0; bit < 8; ++bit) {
+		if (native::pin_level(static_cast<uint8_t>((port - 1) * 8 + bit)))
+			value |= 1u << bit;
+	}
+	return static_cast<uint8_t>(value);
+}
+
+auto native::PortRegister::operator=(uint8_t value) -> PortRegister& {
+	for (uint8_t bit = 0; bit < 8; ++bit) {
+		native::set_pin_level(static_cast<uint8_t>((port - 1) * 8 + bit),
+							  value & (1u << bit));
+	}
+	return *this;
+}
+
+auto portOutputRegister(uint8_t port) -> native::PortRegister* {
+	static native::PortRegister registers[native::PIN_COUNT / 8 + 2];
+	registers[port].port = port;
+	return &registers[port];
+}
+
+// Console on stdin/stdout, the way the Mega's USB serial port is used
+auto init() -> void {
+	setvbuf(stdout, nullptr, _IONBF, 0);
+	fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+	native::set_tx_sink(Serial, stdout_sink, nullptr);
+	if (auto const* path = getenv("NATIVE_EEPROM"))
+		native::set_eeprom_file(path);
+}
+
+auto serialEventRun() -> void {
+	uint8_t buf[64];
+	auto const n = ::read(STDIN_FILENO, buf, sizeof(buf));
+	if (n > 0)
+		native::push_rx(Serial, buf, static_cast<uint32_t>(n));
+}
+
+// HardwareSerial
+
+auto HardwareSerial::read() -> int {
+	if (rx.empty())
+		return -1;
+	auto const b = rx.front();
+	rx.pop_front();
+	return b;
+}
+
+auto HardwareSerial::peek() -> int { return rx.empty() ? -1 : rx.front(); }
+
+auto HardwareSerial::write(uint8_t const* buffer, size_t size) -> size_t {
+	if (tx_sink)
+		tx_sink(tx_ctx, buffer, static_cast<uint32_t>(size));
+	return size;
+}
+
+// Stream
+
+auto Stream::timedRead() -> int {
+	auto const start = millis();
+	do {
+		auto const c = read();
+		if (c >= 0)
+			return c;
+		// Virtual time only moves when the host says so, waiting is pointless
+		if (native::virtual_time())
+			return -1;
+	} while (millis() - start < timeout);
+	return -1;
+}
+
+auto Stream::readBytes(char* buffer, size_t length) -> size_t {
+	size_t count = 0;
+	while (count < length) {
+		auto const c = timedRead();
+		if (c < 0)
+			break;
+		buffer[count++] = static_cast<char>(c);
+	}
+	return count;
+}
+
+auto Stream::readStringUntil(char terminator) -> String {
+	auto ret = String{};
+	for (auto c = timedRead(); c >= 0 && c != terminator; c = timedRead())
+		ret += static_cast<char>(c);
+	return ret;
+}
+
+// Print
+
+auto Print::write(uint8_t const* buffer, size_t size) -> size_t {
+	size_t n = 0;
+	while (size--)
+		n += write(*buffer++);
+	return n;
+}
+
+auto Print::print(char const* str) -> size_t { return write(str); }
+
+auto Print::print(__FlashStringHelper const* str) -> size_t {
+	auto const* p = reinterpret_cast<char const*>(str);
+	return write(reinterpret_cast<uint8_t const*>(p), strlen_P(p));
+}
+
+auto Print::print(String const& s) -> size_t {
+	return write(reinterpret_cast<uint8_t const*>(s.c_str()), s.length());
+}
+
+auto Print::print(char c) -> size_t { return write(static_cast<uint8_t>(c)); }
+
+auto Print::print(unsigned char b, int base) -> size_t {
+	return print(static_cast<unsigned long>(b), base);
+}
+
+auto Print::print(int n, int base) -> size_t {
+	return print(static_cast<long>(n), base);
+}
+
+auto Print::print(unsigned int n, int base) -> size_t {
+	return print(static_cast<unsigned long>(n), base);
+}
+
+auto Print::print(long n, int base) -> size_t {
+	if (base == 0)
+		return write(static_cast<uint8_t>(n));
+	if (base == 10 && n < 0) {
+		auto const t = print('-');
+		return t + printNumber(-static_cast<unsigned long>(n), 10);
+	}
+	return printNumber(static_cast<unsigned long>(n), base);
+}
+
+auto Print::print(unsigned long n, int base) -> size_t {
+	if (base == 0)
+		return write(static_cast<uint8_t>(n));
+	return printNumber(n, base);
+}
+
+auto Print::print(double number, int digits) -> size_t {
+	char buf[48];
+	auto const len = snprintf(buf, sizeof(buf), "%.*f", digits, number);
+	return write(reinterpret_cast<uint8_t const*>(buf),
+				 static_cast<size_t>(len));
+}
+
+auto Print::println() -> size_t { return write("\r\n"); }
+
+auto Print::printNumber(unsigned long n, uint8_t base) -> size_t {
+	char buf[8 * sizeof(long) + 1];
+	auto* str = &buf[sizeof(buf) - 1];
+	*str = '\0';
+	if (base < 2)
+		base = 10;
+	do {
+		auto const digit = static_cast<char>(n % base);
+		n /= base;
+		*--str = digit < 10 ? digit + '0' : digit + 'A' - 10;
+	} while (n);
+	return write(str);
+}
+
+// String
+
+String::String(long value, unsigned char base) {
+	if (base == 10) {
+		s = std::to_string(value);
+		return;
+	}
+	*this = String{static_cast<unsigned long>(value), base};
+}
+
+String::String(unsigned long value, unsigned char base) {
+	if (base < 2)
+		base = 10;
+	do {
+		auto const digit = static_cast<char>(value % base);
+		value /= base;
+		s.insert(s.begin(), digit < 10 ? digit + '0' : digit + 'a' - 10);
+	} while (value);
+}
+
+auto String::trim() -> void {
+	auto const first = s.find_first_not_of(" \t\r\n");
+	auto const last = s.find_last_not_of(" \t\r\n");
+	s = first == std::string::npos ? std::string{}
+								   : s.substr(first, last - first + 1);
+}
+
+// EEPROM
+
+auto eeprom_read_byte(uint8_t const* addr) -> uint8_t {
+	return eeprom_image()[eeprom_index(addr)];
+}
+
+auto eeprom_write_byte(uint8_t* addr, uint8_t value) -> void {
+	eeprom_image()[eeprom_index(addr)] = value;
+	eeprom_flush();
+}
+
+auto eeprom_update_byte(uint8_t* addr, uint8_t value) -> void {
+	if (eeprom_read_byte(addr) != value)
+		eeprom_write_byte(addr, value);
+}
+
+auto eeprom_read_block(void* dst, void const* src, size_t n) -> void {
+	auto* out = static_cast<uint8_t*>(dst);
+	auto const base = eeprom_index(src);
+	for (size_t i = 0; i < n; ++i)
+		out[i] = eeprom_image()[(base + i) & E2END];
+}
+
+auto eeprom_write_block(void const* src, void* dst, size_t n) -> void {
+	auto const* in = static_cast<uint8_t const*>(src);
+	auto const base = eeprom_index(dst);
+	for (size_t i = 0; i < n; ++i)
+		eeprom_image()[(base + i) & E2END] = in[i];
+	eeprom_flush();
+}
+
+auto eeprom_update_block(void const* src, void* dst, size_t n) -> void {
+	eeprom_write_block(src, dst, n);
+}
+
+auto eeprom_is_ready() -> bool { return true; }
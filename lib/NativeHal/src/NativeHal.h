@@ -0,0 +1,36 @@
+#pragma once
+// Host-side controls for the native build. Nothing in src/ should include
+// this; it is meant for host tools that drive the firmware headers.
+
+#include <stdint.h>
+
+class HardwareSerial;
+
+namespace native {
+
+constexpr auto PIN_COUNT = 70;
+
+// Pin levels are physical (HIGH/LOW), DirectIO stand-ins apply the inversion
+auto pin_level(uint8_t pin) -> bool;
+auto set_pin_level(uint8_t pin, bool level) -> void;
+
+// By default millis()/micros() follow the host monotonic clock. Switching to
+// virtual time freezes the clock until advance_us() or set_time_us() is called
+auto use_virtual_time(uint64_t start_us = 0) -> void;
+auto use_real_time() -> void;
+auto virtual_time() -> bool;
+auto set_time_us(uint64_t us) -> void;
+auto advance_us(uint64_t us) -> void;
+
+using TxSink = void (*)(void* ctx, uint8_t const* data, uint32_t len);
+
+// Bytes written by the firmware to `serial` are handed to `sink`
+auto set_tx_sink(HardwareSerial& serial, TxSink sink, void* ctx) -> void;
+// Bytes pushed here are what the firmware later reads from `serial`
+auto push_rx(HardwareSerial& serial, uint8_t const* data, uint32_t len)
+	-> void;
+
+// When set, the EEPROM image is loaded from and written through to `path`
+auto set_eeprom_file(char const* path) -> void;
+
+}  // namespace native
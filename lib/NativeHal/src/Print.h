@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print {
+   public:
+	virtual ~Print() = default;
+
+	virtual auto write(uint8_t) -> size_t = 0;
+	virtual auto write(uint8_t const* buffer, size_t size) -> size_t;
+	auto write(char const* str) -> size_t {
+		return str ? write(reinterpret_cast<uint8_t const*>(str), strlen(str))
+				   : 0;
+	}
+	virtual auto availableForWrite() -> int { return 0; }
+
+	auto print(char const*) -> size_t;
+	auto print(__FlashStringHelper const*) -> size_t;
+	auto print(String const&) -> size_t;
+	auto print(char) -> size_t;
+	auto print(unsigned char, int = DEC) -> size_t;
+	auto print(int, int = DEC) -> size_t;
+	auto print(unsigned int, int = DEC) -> size_t;
+	auto print(long, int = DEC) -> size_t;
+	auto print(unsigned long, int = DEC) -> size_t;
+	auto print(double, int = 2) -> size_t;
+
+	auto println() -> size_t;
+	template <class T>
+	auto println(T value) -> size_t {
+		auto const n = print(value);
+		return n + println();
+	}
+	template <class T>
+	auto println(T value, int format) -> size_t {
+		auto const n = print(value, format);
+		return n + println();
+	}
+
+   private:
+	auto printNumber(unsigned long, uint8_t base) -> size_t;
+};
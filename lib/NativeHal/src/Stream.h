@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Print.h"
+
+class Stream : public Print {
+   public:
+	virtual auto available() -> int = 0;
+	virtual auto read() -> int = 0;
+	virtual auto peek() -> int = 0;
+
+	auto setTimeout(unsigned long timeout) -> void { this->timeout = timeout; }
+	auto getTimeout() const -> unsigned long { return timeout; }
+
+	auto readBytes(char* buffer, size_t length) -> size_t;
+	auto readBytes(uint8_t* buffer, size_t length) -> size_t {
+		return readBytes(reinterpret_cast<char*>(buffer), length);
+	}
+	auto readStringUntil(char terminator) -> String;
+
+   protected:
+	auto timedRead() -> int;
+
+	unsigned long timeout = 1000;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <string.h>
+#include <string>
+#include "avr/pgmspace.h"
+
+// Text in program memory, only ever used through a pointer
+class __FlashStringHelper;
+#define F(string_literal) \
+	(reinterpret_cast<__FlashStringHelper const*>(PSTR(string_literal)))
+
+// Subset of the Arduino String API backed by std::string
+class String {
+   public:
+	String(char const* cstr = "") : s{cstr ? cstr : ""} {}
+	String(std::string s) : s{static_cast<std::string&&>(s)} {}
+	explicit String(char c) : s(1, c) {}
+	explicit String(unsigned char value, unsigned char base = 10)
+		: String{static_cast<unsigned long>(value), base} {}
+	explicit String(int value, unsigned char base = 10)
+		: String{static_cast<long>(value), base} {}
+	explicit String(unsigned int value, unsigned char base = 10)
+		: String{static_cast<unsigned long>(value), base} {}
+	explicit String(long value, unsigned char base = 10);
+	explicit String(unsigned long value, unsigned char base = 10);
+
+	auto length() const -> unsigned int {
+		return static_cast<unsigned int>(s.size());
+	}
+	auto c_str() const -> char const* { return s.c_str(); }
+	auto reserve(unsigned int size) -> bool {
+		s.reserve(size);
+		return true;
+	}
+
+	auto concat(String const& str) -> bool {
+		s += str.s;
+		return true;
+	}
+	auto concat(char const* cstr) -> bool {
+		s += cstr;
+		return true;
+	}
+	auto concat(char c) -> bool {
+		s += c;
+		return true;
+	}
+
+	auto operator+=(String const& rhs) -> String& {
+		concat(rhs);
+		return *this;
+	}
+	auto operator+=(char const* rhs) -> String& {
+		concat(rhs);
+		return *this;
+	}
+	auto operator+=(char rhs) -> String& {
+		concat(rhs);
+		return *this;
+	}
+
+	auto equals(String const& rhs) const -> bool { return s == rhs.s; }
+	auto equals(char const* rhs) const -> bool { return s == rhs; }
+	auto operator==(String const& rhs) const -> bool { return equals(rhs); }
+	auto operator==(char const* rhs) const -> bool { return equals(rhs); }
+	auto operator!=(String const& rhs) const -> bool { return !equals(rhs); }
+	auto operator!=(char const* rhs) const -> bool { return !equals(rhs); }
+
+	auto startsWith(String const& prefix) const -> bool {
+		return s.compare(0, prefix.s.size(), prefix.s) == 0;
+	}
+	auto endsWith(String const& suffix) const -> bool {
+		return s.size() >= suffix.s.size() &&
+			   s.compare(s.size() - suffix.s.size(), suffix.s.size(),
+						 suffix.s) == 0;
+	}
+
+	auto charAt(unsigned int index) const -> char {
+		return index < s.size() ? s[index] : 0;
+	}
+	auto operator[](unsigned int index) const -> char { return charAt(index); }
+	auto operator[](unsigned int index) -> char& { return s[index]; }
+
+	auto begin() -> char* { return &s[0]; }
+	auto end() -> char* { return &s[0] + s.size(); }
+	auto begin() const -> char const* { return s.data(); }
+	auto end() const -> char const* { return s.data() + s.size(); }
+
+	auto indexOf(char c, unsigned int from = 0) const -> int {
+		auto const pos = s.find(c, from);
+		return pos == std::string::npos ? -1 : static_cast<int>(pos);
+	}
+	auto substring(unsigned int from) const -> String {
+		return from < s.size() ? String{s.substr(from)} : String{};
+	}
+	auto substring(unsigned int from, unsigned int to) const -> String {
+		return from < s.size() && to > from ? String{s.substr(from, to - from)}
+											: String{};
+	}
+	auto trim() -> void;
+	auto toInt() const -> long { return strtol(s.c_str(), nullptr, 10); }
+
+	friend auto operator+(String lhs, String const& rhs) -> String {
+		lhs.s += rhs.s;
+		return lhs;
+	}
+	friend auto operator+(String lhs, char const* rhs) -> String {
+		lhs.s += rhs;
+		return lhs;
+	}
+	friend auto operator+(char const* lhs, String const& rhs) -> String {
+		return String{lhs} + rhs;
+	}
+	friend auto operator+(String lhs, char rhs) -> String {
+		lhs.s += rhs;
+		return lhs;
+	}
+
+   private:
+	std::string s;
+};
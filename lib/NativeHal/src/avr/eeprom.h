@@ -0,0 +1,16 @@
+#pragma once
+// Native stand-in for avr-libc's EEPROM API, backed by a 4 KiB RAM image
+// (optionally mirrored to a file, see native::set_eeprom_file)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0xFFF
+
+auto eeprom_read_byte(uint8_t const* addr) -> uint8_t;
+auto eeprom_write_byte(uint8_t* addr, uint8_t value) -> void;
+auto eeprom_update_byte(uint8_t* addr, uint8_t value) -> void;
+auto eeprom_read_block(void* dst, void const* src, size_t n) -> void;
+auto eeprom_write_block(void const* src, void* dst, size_t n) -> void;
+auto eeprom_update_block(void const* src, void* dst, size_t n) -> void;
+auto eeprom_is_ready() -> bool;
@@ -0,0 +1,12 @@
+#pragma once
+// Native stand-in for avr-libc's interrupt API. Nothing runs concurrently
+// on the host, so there is nothing to mask. Of the vectors only Timer0
+// compare A and EEPROM ready exist: NativeHal calls them once per millis()
+// tick while enabled (TIMSK0 OCIE0A, EECR EERIE), see run_isrs().
+
+inline auto cli() -> void {}
+inline auto sei() -> void {}
+
+#define TIMER0_COMPA_vect __vector_TIMER0_COMPA
+#define EE_READY_vect __vector_EE_READY
+#define ISR(vector) extern "C" void vector()
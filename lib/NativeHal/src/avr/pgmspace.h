@@ -0,0 +1,38 @@
+#pragma once
+// Native stand-in for avr-libc's program memory API. The host has a single
+// address space, so PROGMEM data is ordinary const data read in place.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+
+// A statement expression like avr-libc's, so it is also rejected outside
+// functions here
+#define PSTR(s) \
+	(__extension__({ static char const __c[] PROGMEM = (s); &__c[0]; }))
+
+inline auto pgm_read_byte(void const* addr) -> uint8_t {
+	return *static_cast<uint8_t const*>(addr);
+}
+
+inline auto pgm_read_word(void const* addr) -> uint16_t {
+	uint16_t v;
+	memcpy(&v, addr, sizeof(v));
+	return v;
+}
+
+inline auto memcpy_P(void* dst, void const* src, size_t n) -> void* {
+	return memcpy(dst, src, n);
+}
+
+inline auto strlen_P(char const* s) -> size_t { return strlen(s); }
+
+inline auto strcmp_P(char const* s, char const* flash) -> int {
+	return strcmp(s, flash);
+}
+
+inline auto strncmp_P(char const* s, char const* flash, size_t n) -> int {
+	return strncmp(s, flash, n);
+}
@@ -0,0 +1,13 @@
+#pragma once
+// Native stand-in for avr-libc's sleep API. sleep_cpu() returns at the next
+// millis() tick, like the Timer0 interrupt would wake the AVR, and picks up
+// console input on the way like the UART interrupt would.
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE 0
+
+inline auto set_sleep_mode(uint8_t) -> void {}
+inline auto sleep_enable() -> void {}
+inline auto sleep_disable() -> void {}
+auto sleep_cpu() -> void;
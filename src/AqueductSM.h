@@ -1,136 +1,148 @@
 #pragma once
 
-#include "Edge.h"
+#include "Clock.h"
+#include "Fsm.h"
+#include "InputDebouncer.h"
 #include "Log.h"
 #include "Time.h"
 
-using kev::EdgeDebounced;
 using kev::Timestamp;
 using namespace kev::literals;
 
-enum class AqState {
+enum class AqState : uint8_t {
 	STOPPED,
 	FILLING,
 	FILLING_PUMP,
+
+	LAST,
+};
+
+enum class AqEvent : uint8_t {
+	PUMP_ON,
+	PUMP_OFF,
+	VALVE_ON,
+	VALVE_OFF,
+	SENSOR_HI,
+
+	LAST,
 };
 
-template <class OutIngressValve, class OutPump, class InLevelHi>
+template <class OutIngressValve, class OutPump>
 struct AqueductSM {
+	using Fsm = kev::Fsm<AqueductSM, AqState, AqEvent>;
+
 	AqueductSM(OutIngressValve& out_ingress_valve,
 			   OutPump& out_pump,
-			   InLevelHi& in_level_hi)
+			   kev::DebouncedInput in_level_hi)
 		: out_ingress_valve{out_ingress_valve},
 		  out_pump{out_pump},
-		  in_level_hi_edge{in_level_hi, 5_s} {}
-
-	auto tick(Timestamp now) -> void {
-		in_level_hi_edge.update(now);
+		  in_level_hi_edge{in_level_hi} {}
 
+	auto tick(Timestamp) -> void {
+		in_level_hi_edge.update();
 		if (in_level_hi_edge.risingEdge()) {
 			event_sensor_hi();
 		}
 	}
 
-	auto event_pump_on() -> void {
-		switch (state) {
-		case AqState::STOPPED:
-		case AqState::FILLING: return set_state(AqState::FILLING_PUMP);
-		case AqState::FILLING_PUMP: return;
-		}
-		log("Invalid state on event_pump_on");
-	}
-
-	auto event_pump_off() -> void {
-		switch (state) {
-		case AqState::STOPPED:
-		case AqState::FILLING: return;
-		case AqState::FILLING_PUMP: return set_state(AqState::FILLING);
-		}
-		log("Invalid state on event_pump_off");
-	}
-
-	auto event_valve_on() -> void {
-		switch (state) {
-		case AqState::STOPPED: return set_state(AqState::FILLING);
-		case AqState::FILLING:
-		case AqState::FILLING_PUMP: return;
-		}
-		log("Invalid state on event_valve_on");
-	}
-
-	auto event_valve_off() -> void {
-		switch (state) {
-		case AqState::STOPPED: return;
-		case AqState::FILLING:
-		case AqState::FILLING_PUMP: return set_state(AqState::STOPPED);
-		}
-		log("Invalid state on event_valve_off");
+	auto next_deadline(Timestamp now) -> Timestamp {
+		return in_level_hi_edge.next_deadline(now);
 	}
 
-	auto event_sensor_hi() -> void {
-		switch (state) {
-		case AqState::STOPPED: return;
-		case AqState::FILLING:
-		case AqState::FILLING_PUMP: return set_state(AqState::STOPPED);
+	// Events that do not apply to the current state are ignored quietly
+	auto event_pump_on() -> void { event(AqEvent::PUMP_ON); }
+	auto event_pump_off() -> void { event(AqEvent::PUMP_OFF); }
+	auto event_valve_on() -> void { event(AqEvent::VALVE_ON); }
+	auto event_valve_off() -> void { event(AqEvent::VALVE_OFF); }
+	auto event_sensor_hi() -> void { event(AqEvent::SENSOR_HI); }
+
+	// After a restart, back to where a snapshot left off
+	auto resume(AqState s) -> void {
+		if (s >= AqState::LAST) {
+			log(TOK("Invalid state on resume"));
+			return;
 		}
-		log("Invalid state on event_sensor_hi");
+		if (fsm.set(*this, s))
+			fsm.tick(*this, kev::Clock::now());
 	}
 
 	auto log_debug() -> void {
-		log("State = ", state_text(), ", Sensor Hi = ", sensor_hi_text());
+		log(TOK("State = "), state_text(), TOK(", Sensor Hi = "),
+			sensor_hi_text());
 	}
 
-	[[nodiscard]] auto get_state() const -> AqState { return state; }
+	[[nodiscard]] auto get_state() const -> AqState { return fsm.current(); }
 	[[nodiscard]] auto get_valve() const -> bool { return out_ingress_valve; }
 	[[nodiscard]] auto get_pump() const -> bool { return out_pump; }
 
-   private:
-	auto set_state(AqState s) {
-		state = s;
+	static auto fsm_table() -> typename Fsm::Table const& {
+		using S = AqState;
+		using E = AqEvent;
+		// clang-format off
+		static constexpr auto table PROGMEM = typename Fsm::Table{
+			{
+				{S::STOPPED, "STOPPED", &AqueductSM::enter_stopped, nullptr, nullptr},
+				{S::FILLING, "FILLING", &AqueductSM::enter_filling, nullptr, nullptr},
+				{S::FILLING_PUMP, "FILLING_PUMP", &AqueductSM::enter_filling_pump, nullptr, nullptr},
+			},
+			{
+				{E::PUMP_ON, "pump_on"},
+				{E::PUMP_OFF, "pump_off"},
+				{E::VALVE_ON, "valve_on"},
+				{E::VALVE_OFF, "valve_off"},
+				{E::SENSOR_HI, "sensor_hi"},
+			},
+			{
+				{S::STOPPED, E::PUMP_ON, S::FILLING_PUMP},
+				{S::STOPPED, E::VALVE_ON, S::FILLING},
+
+				{S::FILLING, E::PUMP_ON, S::FILLING_PUMP},
+				{S::FILLING, E::VALVE_OFF, S::STOPPED},
+				{S::FILLING, E::SENSOR_HI, S::STOPPED},
+
+				{S::FILLING_PUMP, E::PUMP_OFF, S::FILLING},
+				{S::FILLING_PUMP, E::VALVE_OFF, S::STOPPED},
+				{S::FILLING_PUMP, E::SENSOR_HI, S::STOPPED},
+			},
+		};
+		// clang-format on
+		return table;
+	}
 
-		handle_state_change();
+   private:
+	// The outputs follow the state right away, so get_valve() and
+	// get_pump() are never behind it
+	auto event(AqEvent e) -> void {
+		if (fsm.dispatch(*this, e))
+			fsm.tick(*this, kev::Clock::now());
 	}
 
-	auto handle_state_change() -> void {
-		switch (state) {
-		case AqState::STOPPED: {
-			out_ingress_valve = false;
-			out_pump = false;
-		};
-			return;
-		case AqState::FILLING: {
-			out_ingress_valve = true;
-			out_pump = false;
-		};
-			return;
-		case AqState::FILLING_PUMP: {
-			out_ingress_valve = true;
-			out_pump = true;
-		};
-			return;
-		}
-		log("Invalid state on handle_state_change");
+	auto enter_stopped(Timestamp) -> void {
+		out_ingress_valve = false;
+		out_pump = false;
 	}
 
-	auto state_text() -> char const* {
-		switch (state) {
-		case AqState::STOPPED: return "STOPPED";
-		case AqState::FILLING: return "FILLING";
-		case AqState::FILLING_PUMP: return "FILLING_PUMP";
-		}
+	auto enter_filling(Timestamp) -> void {
+		out_ingress_valve = true;
+		out_pump = false;
+	}
 
-		return "UNKNOWN (Error)";
+	auto enter_filling_pump(Timestamp) -> void {
+		out_ingress_valve = true;
+		out_pump = true;
 	}
 
-	auto sensor_hi_text() -> char const* {
-		return in_level_hi_edge.value() ? "ON" : "OFF";
+	auto state_text() -> kev::LogText { return Fsm::name(get_state()); }
+
+	auto sensor_hi_text() -> kev::LogText {
+		return in_level_hi_edge.value() ? TOK("ON") : TOK("OFF");
 	}
 
 	OutIngressValve& out_ingress_valve;
 	OutPump& out_pump;
-	EdgeDebounced<InLevelHi> in_level_hi_edge;
+	kev::DebouncedInput in_level_hi_edge;
 
-	Log<> log = Log<>{"aqueduct"};
+	Log<> log = Log<>{TOK("aqueduct")};
 
-	AqState state = AqState::STOPPED;
+	Fsm fsm;
 };
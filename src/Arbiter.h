@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace kev {
+
+// Lends a resource to one consumer at a time. Whoever asks while it is
+// taken waits in line, and the first in line gets it as soon as the holder
+// releases it. Consumers are numbered from 0 to CAPACITY - 1.
+struct Arbiter {
+	static constexpr uint8_t CAPACITY = 8;
+	static constexpr uint8_t NONE = 0xFF;
+
+	// One consumer's side of the arbiter
+	struct Handle {
+		auto request() -> bool { return arbiter.request(id); }
+		auto release() -> void { arbiter.release(id); }
+		[[nodiscard]] auto holds() const -> bool { return arbiter.holds(id); }
+		[[nodiscard]] auto position() const -> uint8_t {
+			return arbiter.position(id);
+		}
+
+		Arbiter& arbiter;
+		uint8_t id;
+	};
+
+	auto handle(uint8_t id) -> Handle { return Handle{*this, id}; }
+
+	// True when `id` holds the resource, otherwise it stays in line until
+	// holds() turns true
+	auto request(uint8_t id) -> bool {
+		if (position(id) == NONE && count < CAPACITY)
+			line[count++] = id;
+		return holds(id);
+	}
+
+	// Gives up the resource or the place in line, nothing when neither
+	auto release(uint8_t id) -> void {
+		auto const at = position(id);
+		if (at == NONE)
+			return;
+		--count;
+		for (auto i = at; i < count; ++i)
+			line[i] = line[i + 1];
+	}
+
+	[[nodiscard]] auto holds(uint8_t id) const -> bool {
+		return count > 0 && line[0] == id;
+	}
+
+	// 0 for the holder, then 1 for the first one waiting, and so on. NONE
+	// when `id` neither holds nor waits.
+	[[nodiscard]] auto position(uint8_t id) const -> uint8_t {
+		for (uint8_t i = 0; i < count; ++i) {
+			if (line[i] == id)
+				return i;
+		}
+		return NONE;
+	}
+
+   private:
+	// The holder first, then whoever waits in the order they asked
+	uint8_t line[CAPACITY] = {};
+	uint8_t count = 0;
+};
+
+}  // namespace kev
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "Time.h"
+
+namespace kev {
+
+// Time since boot, all of it from Timer0 as the Arduino core sets it up
+// (4 us resolution at 16 MHz).
+//
+// now() is the fast path: 32 bits of milliseconds, what state machines and
+// deadlines use. It wraps every 49.7 days, which differences between
+// Timestamps survive, see Time.h. ticks_us() is 32 bits of microseconds for
+// timing short stretches of code; it wraps every 71.6 minutes. now_us() is
+// 64 bits and does not wrap for 584 thousand years, it counts the wraps of
+// ticks_us() as they are seen.
+//
+// From the main loop only. Some call has to come at least once per 71.6
+// minutes for now_us() to see every wrap; the Scheduler makes one every
+// pass, and passes are never further apart than NO_DEADLINE.
+struct Clock {
+	static auto now() -> Timestamp { return Timestamp{millis()}; }
+
+	static auto ticks_us() -> uint32_t {
+		auto const us = static_cast<uint32_t>(micros());
+		if (us < last_us)
+			++wraps;
+		last_us = us;
+		return us;
+	}
+
+	static auto now_us() -> uint64_t {
+		auto const us = ticks_us();
+		return static_cast<uint64_t>(wraps) << 32 | us;
+	}
+
+	static auto uptime_s() -> unsigned long {
+		return static_cast<unsigned long>(now_us() / 1000000u);
+	}
+
+   private:
+	static inline uint32_t last_us = 0;
+	static inline uint32_t wraps = 0;
+};
+
+}  // namespace kev
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include "Flash.h"
+
+namespace kev {
+
+// Fixed capacity, always null terminated text that lives wherever it is
+// declared. Appends past the capacity are cut off instead of allocating.
+template <uint8_t Capacity>
+class FixedString {
+   public:
+	auto append(char c) -> FixedString& {
+		if (len < Capacity) {
+			buffer[len++] = c;
+			buffer[len] = '\0';
+		}
+		return *this;
+	}
+
+	auto append(char const* s) -> FixedString& {
+		while (*s && len < Capacity)
+			buffer[len++] = *s++;
+		buffer[len] = '\0';
+		return *this;
+	}
+
+	auto append(FlashString s) -> FixedString& {
+		auto const* p = flash_chars(s);
+		for (char c; (c = pgm_read_byte(p++)) && len < Capacity;)
+			buffer[len++] = c;
+		buffer[len] = '\0';
+		return *this;
+	}
+
+	auto append(unsigned long n) -> FixedString& {
+		char digits[10];
+		uint8_t count = 0;
+		do {
+			digits[count++] = static_cast<char>('0' + n % 10);
+			n /= 10;
+		} while (n);
+		while (count)
+			append(digits[--count]);
+		return *this;
+	}
+
+	auto append(long n) -> FixedString& {
+		if (n < 0) {
+			append('-');
+			return append(0ul - static_cast<unsigned long>(n));
+		}
+		return append(static_cast<unsigned long>(n));
+	}
+
+	auto append(int n) -> FixedString& { return append(static_cast<long>(n)); }
+
+	// At least two digits, "07"
+	auto append_pad2(long n) -> FixedString& {
+		if (n >= 0 && n < 10)
+			append('0');
+		return append(n);
+	}
+
+	auto clear() -> void {
+		len = 0;
+		buffer[0] = '\0';
+	}
+
+	[[nodiscard]] auto c_str() const -> char const* { return buffer; }
+	[[nodiscard]] auto size() const -> uint8_t { return len; }
+
+   private:
+	char buffer[Capacity + 1] = {};
+	uint8_t len = 0;
+};
+
+}  // namespace kev
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "Hash.h"
+
+namespace kev {
+
+// Text left in program memory, what F() gives. The AVR copies every plain
+// literal into SRAM at startup; these are read a byte at a time instead.
+using FlashString = __FlashStringHelper const*;
+
+inline auto flash_chars(FlashString s) -> char const* {
+	return reinterpret_cast<char const*>(s);
+}
+
+inline auto flash_strlen(FlashString s) -> size_t {
+	return strlen_P(flash_chars(s));
+}
+
+inline auto flash_equal(FlashString a, FlashString b) -> bool {
+	auto const* p = flash_chars(a);
+	auto const* q = flash_chars(b);
+	if (p == q)
+		return true;
+	for (;; ++p, ++q) {
+		auto const c = pgm_read_byte(p);
+		if (c != pgm_read_byte(q))
+			return false;
+		if (!c)
+			return true;
+	}
+}
+
+// Same as fnv1a(), for text in program memory
+inline auto flash_fnv1a(FlashString s) -> uint32_t {
+	auto h = Fnv1a{};
+	for (auto const* p = flash_chars(s); auto const c = pgm_read_byte(p); ++p)
+		h.add(c);
+	return h.value;
+}
+
+}  // namespace kev
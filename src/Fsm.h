@@ -0,0 +1,201 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Flash.h"
+#include "Log.h"
+#include "Time.h"
+
+namespace kev {
+
+// Calling it from a constant expression is what makes the build fail
+inline auto fsm_name_too_long() -> void {}
+
+// Name of a state or event, copied into the table when it is built so the
+// literals in the definitions never reach the firmware
+#ifdef KEV_LOG_TOKENIZED
+// Only ever logged, as the token TOK() would give
+struct FsmName {
+	constexpr FsmName() = default;
+	constexpr explicit FsmName(char const* s) : id{token_id(s)} {}
+
+	[[nodiscard]] auto read() const -> LogText {
+		return Token{pgm_read_word(&id)};
+	}
+
+	uint16_t id = 0;
+};
+#else
+struct FsmName {
+	static constexpr uint8_t SIZE = 20;
+
+	constexpr FsmName() = default;
+	constexpr explicit FsmName(char const* s) {
+		for (uint8_t i = 0; s[i]; ++i) {
+			if (i == SIZE - 1)
+				fsm_name_too_long();
+			text[i] = s[i];
+		}
+	}
+
+	[[nodiscard]] auto read() const -> LogText {
+		return reinterpret_cast<LogText>(text);
+	}
+
+	char text[SIZE] = {};
+};
+#endif
+
+// Table driven state machine engine. A machine declares its states (name,
+// entry/exit actions, guard), events and transitions once, as a constexpr
+// Table returned by a static Machine::fsm_table(), instead of repeating a
+// switch per event. State and Event are enums ending in LAST.
+//
+// The transitions are flattened at compile time into a [state][event]
+// array, so dispatch is a single indexed load. An event only changes the
+// state, after the target's guard agreed and the old state's exit action
+// ran; entry actions run from the next tick(), like the hand-written
+// machines did.
+//
+// Machines keep the table in PROGMEM, every read below goes through
+// pgm_read_*.
+
+template <class Machine, class State, class Event>
+struct Fsm {
+	static constexpr uint8_t STATES = static_cast<uint8_t>(State::LAST);
+	static constexpr uint8_t EVENTS = static_cast<uint8_t>(Event::LAST);
+	static constexpr uint8_t NONE = 0xFF;
+
+	using Entry = void (Machine::*)(Timestamp now);
+	// Told where the machine is going, so a state can keep what the next one
+	// still needs
+	using Exit = void (Machine::*)(State to);
+	using Guard = bool (Machine::*)();
+
+	struct StateDef {
+		State state;
+		char const* name;
+		Entry on_entry;
+		Exit on_exit;
+		// Asked before entering, false keeps the current state
+		Guard can_enter;
+	};
+
+	struct EventDef {
+		Event event;
+		char const* name;
+	};
+
+	struct Transition {
+		// State::LAST stands for every state
+		State from;
+		Event event;
+		State to;
+	};
+
+	struct Table {
+		template <size_t N>
+		constexpr Table(StateDef const (&states)[STATES],
+						EventDef const (&events)[EVENTS],
+						Transition const (&transitions)[N]) {
+			for (auto const& s : states) {
+				auto const i = index(s.state);
+				state_names[i] = FsmName{s.name};
+				entry[i] = s.on_entry;
+				exit[i] = s.on_exit;
+				guard[i] = s.can_enter;
+			}
+			for (auto const& e : events)
+				event_names[index(e.event)] = FsmName{e.name};
+
+			for (auto& row : next) {
+				for (auto& to : row)
+					to = NONE;
+			}
+			for (auto const& t : transitions) {
+				for (uint8_t s = 0; s < STATES; ++s) {
+					if (t.from == State::LAST || index(t.from) == s)
+						next[s][index(t.event)] = index(t.to);
+				}
+			}
+		}
+
+		FsmName state_names[STATES] = {};
+		FsmName event_names[EVENTS] = {};
+		Entry entry[STATES] = {};
+		Exit exit[STATES] = {};
+		Guard guard[STATES] = {};
+		uint8_t next[STATES][EVENTS] = {};
+	};
+
+	[[nodiscard]] auto current() const -> State { return state; }
+
+	// Entered but its entry action has not run yet
+	[[nodiscard]] auto changed() const -> bool { return state != prev; }
+
+	static auto name(State s) -> LogText {
+		if (index(s) >= STATES)
+			return TOK("INVALID");
+		return table().state_names[index(s)].read();
+	}
+
+	static auto name(Event e) -> LogText {
+		if (index(e) >= EVENTS)
+			return TOK("INVALID");
+		return table().event_names[index(e)].read();
+	}
+
+	// False when `event` leads nowhere from the current state, or the
+	// target's guard refused it
+	auto dispatch(Machine& m, Event event) -> bool {
+		auto const& row = table().next[index(state)];
+		auto const to = pgm_read_byte(&row[index(event)]);
+		if (to == NONE)
+			return false;
+		return set(m, static_cast<State>(to));
+	}
+
+	// Goes to `to` without a transition, for restoring saved states
+	auto set(Machine& m, State to) -> bool {
+		auto const& t = table();
+		if (auto const guard = read(t.guard[index(to)]); guard && !(m.*guard)())
+			return false;
+		if (auto const exit = read(t.exit[index(state)]); exit && to != state)
+			(m.*exit)(to);
+
+		prev = state;
+		state = to;
+		return true;
+	}
+
+	auto tick(Machine& m, Timestamp now) -> void {
+		if (!changed())
+			return;
+
+		// Before the action, which may dispatch again
+		prev = state;
+		if (auto const entry = read(table().entry[index(state)]))
+			(m.*entry)(now);
+	}
+
+   private:
+	template <class E>
+	static constexpr auto index(E e) -> uint8_t {
+		return static_cast<uint8_t>(e);
+	}
+
+	static auto table() -> Table const& { return Machine::fsm_table(); }
+
+	// Copies an action out of program memory
+	template <class Action>
+	static auto read(Action const& flash) -> Action {
+		auto action = Action{};
+		memcpy_P(&action, &flash, sizeof(action));
+		return action;
+	}
+
+	State state = {};
+	State prev = {};
+};
+
+}  // namespace kev
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace kev {
+
+struct Fnv1a {
+	uint32_t value = 2166136261ul;
+
+	constexpr auto add(uint8_t b) -> Fnv1a& {
+		value = (value ^ b) * 16777619ul;
+		return *this;
+	}
+
+	constexpr auto add(char const* s) -> Fnv1a& {
+		while (*s)
+			add(static_cast<uint8_t>(*s++));
+		return *this;
+	}
+};
+
+// CRC-8, polynomial 0x07. Starting from 0xFF neither an erased (all 0xFF)
+// nor an all-zero block checks out as valid.
+struct Crc8 {
+	uint8_t value = 0xFF;
+
+	constexpr auto add(uint8_t b) -> Crc8& {
+		value ^= b;
+		for (auto i = 0; i < 8; ++i)
+			value = (value & 0x80) ? (value << 1) ^ 0x07 : value << 1;
+		return *this;
+	}
+};
+
+constexpr auto fnv1a(char const* s) -> uint32_t {
+	return Fnv1a{}.add(s).value;
+}
+
+}  // namespace kev
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "Clock.h"
+
+namespace kev {
+
+// Sleeps until `deadline` or until has_work() says an interrupt left
+// something for the loop (typically bytes in a UART buffer).
+//
+// Idle mode keeps Timer0 and the UARTs running, so millis() keeps counting
+// and received bytes still wake the CPU. Timer0 also wakes it every
+// millisecond; those wake-ups only check the deadline and go back to sleep.
+template <class WakeFn>
+auto idle_until(Timestamp deadline, WakeFn has_work) -> void {
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	for (;;) {
+		cli();
+		if (has_work() || (Clock::now() - deadline) >= Duration{0}) {
+			sei();
+			return;
+		}
+		sleep_enable();
+		// The instruction after sei() always runs before any interrupt, so
+		// one arriving since the check above still wakes sleep_cpu() up
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+}
+
+}  // namespace kev
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include "Log.h"
+#include "Time.h"
+#include "Timer.h"
+
+namespace kev {
+
+// Debounces every digital input at once. Each sample reads whole PINx
+// registers, one read per port, and advances a vertical counter: bit k of
+// counts[k] is bit k of the counter of the pin in that position, so the
+// counters of all 8 pins of a port count together in a few byte-wide
+// operations. A pin's counter runs while its raw level differs from the
+// debounced one and starts over when they agree; when it reaches the
+// threshold the debounced level flips. An input has to hold its new level
+// for `stable` before it counts, the same as a timer restarted on every raw
+// change, at the resolution of one sample.
+//
+// Sampled from the Timer0 compare interrupt (see start_input_sampling()),
+// once every SAMPLE_DIVIDER of them: 32.768 ms on the Mega. A sample costs
+// the same with 1 input or 8 on a port, an input on a port already sampled
+// costs nothing more.
+struct InputDebouncer {
+	static constexpr uint8_t PORTS = 4;
+	static constexpr uint8_t PLANES = 8;
+	static constexpr uint8_t SAMPLE_DIVIDER = 32;
+	static constexpr unsigned long SAMPLE_PERIOD_US = 1024ul * SAMPLE_DIVIDER;
+
+	explicit InputDebouncer(Duration stable) : threshold{samples(stable)} {}
+
+	// One input's view of the debouncer, see DebouncedInput
+	struct Slot {
+		// Into the ports sampled, not the port number
+		uint8_t index;
+		uint8_t mask;
+	};
+
+	// Configures `pin` as an input and adds its port to the ones sampled.
+	// Active low inputs read 1 when the pin is low and get the pull-up.
+	// Beyond PORTS ports an input never turns active.
+	auto claim(uint8_t pin, bool active_low) -> Slot {
+		pinMode(pin, active_low ? INPUT_PULLUP : INPUT);
+		auto const port = digitalPinToPort(pin);
+		auto const mask = digitalPinToBitMask(pin);
+		uint8_t i = 0;
+		while (i < used && ports[i].port != port)
+			++i;
+		if (i == PORTS)
+			return {0, 0};
+		if (i == used) {
+			ports[i].port = port;
+			++used;
+		}
+		if (active_low)
+			ports[i].active_low |= mask;
+		return {i, static_cast<uint8_t>(mask)};
+	}
+
+	// From the Timer0 compare interrupt only
+	auto tick() -> void {
+		if (++ticks < SAMPLE_DIVIDER)
+			return;
+		ticks = 0;
+		sample();
+	}
+
+	auto sample() -> void {
+		for (uint8_t i = 0; i < used; ++i)
+			sample(ports[i], raw(ports[i]));
+	}
+
+	// Debounced levels of the inputs in a slot's port, 1 for active
+	[[nodiscard]] auto levels(uint8_t index) const -> uint8_t {
+		return ports[index].levels;
+	}
+
+	// True once after some input changed its debounced level, what wakes
+	// the loop (see kev::idle_until()). Called with interrupts off.
+	auto take_changed() -> bool {
+		auto const was = changed;
+		changed = false;
+		return was;
+	}
+
+	// Some counter is running or will start on the next sample, what a
+	// simulation that skips time has to sample through
+	[[nodiscard]] auto settling() const -> bool {
+		for (uint8_t i = 0; i < used; ++i) {
+			if (ports[i].counting || raw(ports[i]) != ports[i].levels)
+				return true;
+		}
+		return false;
+	}
+
+   private:
+	struct Port {
+		uint8_t port = 0;
+		uint8_t active_low = 0;
+		// Written by the ISR, read by the loop
+		uint8_t volatile levels = 0;
+		bool counting = false;
+		uint8_t counts[PLANES] = {};
+	};
+
+	static constexpr auto samples(Duration stable) -> uint8_t {
+		auto const us = static_cast<unsigned long>(stable.unsafeGetValue()) *
+						1000ul;
+		auto const n = (us + SAMPLE_PERIOD_US - 1) / SAMPLE_PERIOD_US;
+		return n < 1 ? 1 : n > 255 ? 255 : static_cast<uint8_t>(n);
+	}
+
+	static auto raw(Port const& p) -> uint8_t {
+		return static_cast<uint8_t>(*portInputRegister(p.port) ^ p.active_low);
+	}
+
+	auto sample(Port& p, uint8_t raw) -> void {
+		auto const differs = static_cast<uint8_t>(raw ^ p.levels);
+		p.counting = differs != 0;
+
+		// Counters where the levels agree start over, the others count one:
+		// a ripple carry through the planes
+		auto carry = differs;
+		for (auto& plane : p.counts) {
+			plane &= differs;
+			auto const next = static_cast<uint8_t>(plane & carry);
+			plane ^= carry;
+			carry = next;
+		}
+
+		// Counters equal to the threshold, plane by plane
+		auto settled = differs;
+		for (uint8_t k = 0; k < PLANES; ++k)
+			settled &= (threshold >> k & 1) ? p.counts[k] : ~p.counts[k];
+		if (!settled)
+			return;
+
+		p.counting = (differs & ~settled) != 0;
+		p.levels ^= settled;
+		for (auto& plane : p.counts)
+			plane &= ~settled;
+		changed = true;
+	}
+
+	Port ports[PORTS];
+	uint8_t used = 0;
+	uint8_t const threshold;
+	uint8_t ticks = 0;
+	bool volatile changed = false;
+};
+
+// One input as a state machine sees it, with edges relative to the last
+// update(): risingEdge() and fallingEdge() tell which way the debounced level
+// went the last time it changed. Each holder keeps its own edges, so several
+// can watch the same input.
+class DebouncedInput {
+   public:
+	DebouncedInput(InputDebouncer& inputs, uint8_t pin, bool active_low)
+		: inputs{inputs}, slot{inputs.claim(pin, active_low)} {}
+
+	auto update() -> void {
+		auto const level = debounced();
+		if (level == curr)
+			return;
+		prev = curr;
+		curr = level;
+		Log<>{TOK("DebouncedInput")}(TOK("Debounced to "),
+									curr ? TOK("HIGH") : TOK("LOW"));
+	}
+
+	auto risingEdge() -> bool { return changed() && curr; }
+	auto fallingEdge() -> bool { return changed() && !curr; }
+	auto changed() -> bool { return prev != curr; }
+	auto value() -> bool { return curr; }
+
+	// Right away when the debounced level moved since update(), otherwise
+	// the debouncer wakes the loop when it does
+	auto next_deadline(Timestamp now) -> Timestamp {
+		return debounced() != curr ? now : now + NO_DEADLINE;
+	}
+
+   private:
+	auto debounced() const -> bool {
+		return inputs.levels(slot.index) & slot.mask;
+	}
+
+	InputDebouncer& inputs;
+	InputDebouncer::Slot slot;
+	bool prev = false;
+	bool curr = false;
+};
+
+// Timer0 already overflows every 1.024 ms for millis(); its compare match A
+// interrupt is unused by the Arduino core and fires at the same rate.
+// Define ISR(TIMER0_COMPA_vect) to call the debouncer's tick().
+inline auto start_input_sampling() -> void {
+	OCR0A = 0x80;
+	TIMSK0 |= _BV(OCIE0A);
+}
+
+}  // namespace kev
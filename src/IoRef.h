@@ -0,0 +1,34 @@
+#pragma once
+
+namespace kev {
+
+// Any output, reached through a function made for its type, so the code
+// that drives it does not have to be a template on that type. For a
+// StagedOutput the write only lands in OutputStage's shadow of the port; the
+// pin follows in the stage's masked per-port commit.
+//
+// Refers to the output, which has to outlive it.
+struct OutputRef {
+	template <class T>
+	static auto of(T& output) -> OutputRef {
+		return OutputRef{
+			&output,
+			[](void* o, bool value) { *static_cast<T*>(o) = value; },
+			[](void* o) { return static_cast<bool>(*static_cast<T*>(o)); },
+		};
+	}
+
+	auto operator=(bool value) -> OutputRef& {
+		write_fn(target, value);
+		return *this;
+	}
+
+	[[nodiscard]] auto read() const -> bool { return read_fn(target); }
+	explicit operator bool() const { return read(); }
+
+	void* target;
+	void (*write_fn)(void*, bool);
+	bool (*read_fn)(void*);
+};
+
+}  // namespace kev
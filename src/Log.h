@@ -1,11 +1,137 @@
 #pragma once
+#include <string.h>
+#include "Flash.h"
 #include "HardwareSerial.h"
+#include "LogBuffer.h"
+#include "Token.h"
 
 #define INLINE __attribute__((always_inline)) inline
 
+namespace kev {
+
+// Everything logged waits here until main() drains it into Serial
+inline auto log_buffer = LogBuffer<1024>{};
+
+// Log argument shown in base 16
+struct Hex {
+	unsigned long value;
+};
+
+inline auto log_print(Hex h) -> void {
+	log_buffer.print(h.value, HEX);
+}
+
+template <class T>
+INLINE auto log_print(T value) -> void {
+	log_buffer.print(value);
+}
+
+#ifdef KEV_LOG_TOKENIZED
+
+// Binary frames, see LogTag. Deliberately not always_inline, every call site
+// shares one copy of the encoder.
+
+// What TOK() gives, for log names and constant text only ever logged
+using LogText = Token;
+
+inline auto log_tag(LogTag tag) -> void {
+	log_buffer.write(static_cast<uint8_t>(tag));
+}
+
+inline auto log_u16(uint16_t v) -> void {
+	log_buffer.write(static_cast<uint8_t>(v));
+	log_buffer.write(static_cast<uint8_t>(v >> 8));
+}
+
+inline auto log_varint(unsigned long v) -> void {
+	while (v >= 0x80) {
+		log_buffer.write(static_cast<uint8_t>(v | 0x80));
+		v >>= 7;
+	}
+	log_buffer.write(static_cast<uint8_t>(v));
+}
+
+inline auto log_start(LogText name) -> void {
+	log_tag(LogTag::FRAME_START);
+	log_u16(name.id);
+}
+
+inline auto log_end() -> void { log_tag(LogTag::END); }
+
+inline auto log_arg(Token t) -> void {
+	log_tag(LogTag::TOKEN);
+	log_u16(t.id);
+}
+
+inline auto log_arg(char const* s) -> void {
+	auto const len = strlen(s);
+	auto const n = static_cast<uint8_t>(len > 255 ? 255 : len);
+	log_tag(LogTag::STRING);
+	log_buffer.write(n);
+	log_buffer.write(reinterpret_cast<uint8_t const*>(s), n);
+}
+
+inline auto log_arg(String const& s) -> void { log_arg(s.c_str()); }
+
+inline auto log_arg(FlashString s) -> void {
+	auto const len = flash_strlen(s);
+	auto const n = static_cast<uint8_t>(len > 255 ? 255 : len);
+	log_tag(LogTag::STRING);
+	log_buffer.write(n);
+	for (uint8_t i = 0; i < n; ++i)
+		log_buffer.write(pgm_read_byte(flash_chars(s) + i));
+}
+
+inline auto log_arg(char c) -> void {
+	log_tag(LogTag::CHAR);
+	log_buffer.write(static_cast<uint8_t>(c));
+}
+
+inline auto log_arg(unsigned long v) -> void {
+	log_tag(LogTag::UINT);
+	log_varint(v);
+}
+
+inline auto log_arg(long v) -> void {
+	log_tag(LogTag::INT);
+	log_varint((static_cast<unsigned long>(v) << 1) ^ (v < 0 ? ~0ul : 0ul));
+}
+
+inline auto log_arg(bool v) -> void { log_arg(v ? 1ul : 0ul); }
+inline auto log_arg(unsigned char v) -> void { log_arg(0ul + v); }
+inline auto log_arg(unsigned int v) -> void { log_arg(0ul + v); }
+inline auto log_arg(int v) -> void { log_arg(0l + v); }
+
+inline auto log_arg(Hex h) -> void {
+	log_tag(LogTag::UINT_HEX);
+	log_varint(h.value);
+}
+
+#else
+
+using LogText = FlashString;
+
+INLINE auto log_start(LogText name) -> void {
+	log_print('[');
+	log_print(name);
+	log_print(']');
+	log_print(' ');
+}
+
+INLINE auto log_end() -> void { log_print('\n'); }
+
+template <class T>
+INLINE auto log_arg(T value) -> void {
+	log_print(value);
+}
+
+#endif
+
+}  // namespace kev
+
 template <class... Args>
 INLINE auto print(Args... args) -> void {
-	(Serial.print(args), ...);
+	(kev::log_print(args), ...);
 }
 
 template <class... Args>
@@ -13,38 +139,43 @@ INLINE auto println(Args... args) -> void {
 	print(args..., '\n');
 }
 
+// Log names and messages should be wrapped in TOK(), so they stay out of
+// SRAM and KEV_LOG_TOKENIZED builds can send them as 16 bit ids, see
+// tools/logdecode
 template <bool enabled = true>
 struct Log {
-	Log(char const* name) : name{name} {}
+	Log(kev::LogText name) : name{name} {}
 
 	template <class... Args>
 	INLINE auto operator()(Args... args) -> void {
 		if constexpr (enabled) {
-			println('[', name, ']', ' ', args...);
+			kev::log_start(name);
+			(kev::log_arg(args), ...);
+			kev::log_end();
 		}
 	}
 
 	template <class... Args>
 	INLINE auto partial_start() -> void {
 		if constexpr (enabled) {
-			print('[', name, ']', ' ');
+			kev::log_start(name);
 		}
 	}
 
 	template <class... Args>
 	INLINE auto partial_end() -> void {
 		if constexpr (enabled) {
-			println();
+			kev::log_end();
 		}
 	}
 
 	template <class... Args>
 	INLINE auto partial(Args... args) -> void {
 		if constexpr (enabled) {
-			print(args...);
+			(kev::log_arg(args), ...);
 		}
 	}
 
    private:
-	char const* name;
+	kev::LogText name;
 };
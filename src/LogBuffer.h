@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include "Print.h"
+#include "Token.h"
+
+namespace kev {
+
+enum class LogOverflow : uint8_t {
+	// Throw away the oldest complete lines (frames when tokenized) to make
+	// room
+	DROP_OLDEST,
+	// Keep what is queued and discard the new text
+	DROP_NEWEST,
+};
+
+// Log text is queued here and only handed to the UART while its hardware
+// buffer has room, so printing never waits for bytes to go out
+template <uint16_t Size>
+class LogBuffer : public Print {
+   public:
+	auto write(uint8_t b) -> size_t override {
+		if (count == Size && !make_room()) {
+			++overflow_count;
+			return 0;
+		}
+		buffer[(first + count) % Size] = b;
+		++count;
+		return 1;
+	}
+
+	using Print::write;
+
+	// Moves as much as `out` accepts without blocking. An entry can be left
+	// half sent, make_room() keeps the rest of it together.
+	template <class Out>
+	auto drain(Out& out) -> void {
+		while (count) {
+			auto const room = out.availableForWrite();
+			if (room <= 0)
+				return;
+			if (!in_flight) {
+				// One still being written goes as far as it has got
+				in_flight = entry_size(0);
+				if (!in_flight)
+					in_flight = count;
+			}
+			auto n = count < Size - first ? count : Size - first;
+			if (n > in_flight)
+				n = in_flight;
+			if (n > static_cast<uint16_t>(room))
+				n = static_cast<uint16_t>(room);
+			out.write(&buffer[first], n);
+			first = (first + n) % Size;
+			count -= n;
+			in_flight -= n;
+		}
+	}
+
+	auto set_policy(LogOverflow p) -> void { policy = p; }
+	[[nodiscard]] auto pending() const -> uint16_t { return count; }
+	// Bytes lost to DROP_NEWEST plus lines or frames lost to DROP_OLDEST
+	[[nodiscard]] auto overflows() const -> uint16_t { return overflow_count; }
+
+   private:
+	auto make_room() -> bool {
+		if (policy == LogOverflow::DROP_NEWEST)
+			return false;
+
+		// The rest of an entry partly on the wire stays, the entry after it
+		// goes. So does the one being written when nothing older is left.
+		auto const n = entry_size(in_flight);
+		auto const drop = n ? n : count - in_flight;
+		if (!drop)
+			return false;
+		for (auto i = in_flight; i-- > 0;)
+			buffer[(first + drop + i) % Size] = at(i);
+		first = (first + drop) % Size;
+		count -= drop;
+		++overflow_count;
+		return true;
+	}
+
+	auto at(uint16_t i) const -> uint8_t { return buffer[(first + i) % Size]; }
+
+	// Bytes from `from` up to and including the next newline, 0 when there
+	// is none
+	auto line_size(uint16_t from) const -> uint16_t {
+		for (auto i = from; i < count; ++i) {
+			if (at(i) == '\n')
+				return i + 1 - from;
+		}
+		return 0;
+	}
+
+#ifdef KEV_LOG_TOKENIZED
+	// The frame or line of plain text starting `from` bytes in, 0 when it is
+	// not complete. Frames are walked tag by tag: 0x0A (END) and 0xFE
+	// (FRAME_START) are also payload bytes, so searching for either could
+	// cut a frame in half.
+	auto entry_size(uint16_t from) const -> uint16_t {
+		if (at(from) != static_cast<uint8_t>(LogTag::FRAME_START))
+			return line_size(from);
+
+		// FRAME_START, then the name's u16
+		auto i = static_cast<uint16_t>(from + 3);
+		while (i < count) {
+			switch (static_cast<LogTag>(at(i++))) {
+			case LogTag::TOKEN: i += 2; break;
+			case LogTag::INT:
+			case LogTag::UINT:
+			case LogTag::UINT_HEX:
+				while (i < count && (at(i) & 0x80))
+					++i;
+				++i;
+				break;
+			case LogTag::STRING: i = i < count ? i + 1 + at(i) : i + 1; break;
+			case LogTag::CHAR: i += 1; break;
+			case LogTag::END: return i - from;
+			// Not a frame after all, drop what was walked
+			default: return i - from;
+			}
+		}
+		return 0;
+	}
+#else
+	auto entry_size(uint16_t from) const -> uint16_t {
+		return line_size(from);
+	}
+#endif
+
+	uint8_t buffer[Size];
+	uint16_t first = 0;
+	uint16_t count = 0;
+	// Bytes left of the entry drain() has started sending
+	uint16_t in_flight = 0;
+	uint16_t overflow_count = 0;
+	LogOverflow policy = LogOverflow::DROP_OLDEST;
+};
+
+}  // namespace kev
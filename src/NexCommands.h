@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stdint.h>
+#include "NexHardware.h"
+#include "NextionUtils.h"
+#include "Time.h"
+#include "Timer.h"
+
+using namespace kev::literals;
+using kev::Duration;
+using kev::Timestamp;
+
+enum class NexReply : uint8_t {
+	NONE,
+	ACK,
+	NUMBER,
+	STRING,
+};
+
+enum class NexStatus : uint8_t {
+	OK,
+	FAILED,
+	TIMEOUT,
+};
+
+template <class TagT>
+struct NexResult {
+	TagT tag;
+	NexStatus status;
+	uint32_t number;
+	// Payload of a string reply, only valid while handling the result
+	NexFrame frame;
+};
+
+// Commands are written right away and the reply each one expects is queued.
+// The display answers in order, so every reply belongs to the oldest
+// outstanding command. Requires bkcmd=3 so failures are reported too.
+template <class SerialT, class TagT, uint8_t Depth = 8>
+struct NexCommands {
+	NexCommands(SerialT& serial, Duration timeout = 100_ms)
+		: serial{serial}, timeout{timeout} {}
+
+	// Returns false without sending anything when the queue is full
+	template <class... Parts>
+	auto send(Timestamp now, NexReply expect, TagT tag, Parts... parts)
+		-> bool {
+		if (expect != NexReply::NONE) {
+			if (count == Depth) {
+				++dropped_count;
+				return false;
+			}
+			auto& slot = pending[(first + count) % Depth];
+			slot.tag = tag;
+			slot.expect = expect;
+			slot.deadline = now + timeout;
+			++count;
+		}
+
+		(serial.print(parts), ...);
+		serial.print(F("\xFF\xFF\xFF"));
+		return true;
+	}
+
+	// True when `frame` answered the oldest outstanding command
+	auto match(NexFrame frame, NexResult<TagT>& result) -> bool {
+		if (count == 0 || !is_reply(frame)) {
+			return false;
+		}
+
+		// A number or string can only answer a get. When the head expects
+		// something else its reply was lost, so skip ahead to the get.
+		auto const data = data_reply(frame);
+		while (data != NexReply::NONE && count &&
+			   pending[first].expect != data) {
+			++lost_count;
+			pop();
+		}
+		if (count == 0) {
+			return false;
+		}
+
+		auto const& head = pending[first];
+		result = {head.tag, NexStatus::FAILED, 0, {}};
+
+		switch (frame.head()) {
+		case NEX_RET_CMD_FINISHED: {
+			if (head.expect == NexReply::ACK)
+				result.status = NexStatus::OK;
+		}; break;
+		case NEX_RET_NUMBER_HEAD: {
+			if (head.expect == NexReply::NUMBER) {
+				result.status = NexStatus::OK;
+				result.number = (uint32_t{frame[4]} << 24) |
+								(uint32_t{frame[3]} << 16) |
+								(uint32_t{frame[2]} << 8) | frame[1];
+			}
+		}; break;
+		case NEX_RET_STRING_HEAD: {
+			if (head.expect == NexReply::STRING) {
+				result.status = NexStatus::OK;
+				result.frame = {frame.data + 1,
+								static_cast<uint8_t>(frame.size - 1)};
+			}
+		}; break;
+		default: break;  // error code
+		}
+
+		pop();
+		return true;
+	}
+
+	// True when the oldest outstanding command ran out of time
+	auto expire(Timestamp now, NexResult<TagT>& result) -> bool {
+		if (count == 0 || (now - pending[first].deadline) < 0_ms) {
+			return false;
+		}
+
+		result = {pending[first].tag, NexStatus::TIMEOUT, 0, {}};
+		++timeout_count;
+		pop();
+		return true;
+	}
+
+	// When the oldest outstanding command times out
+	[[nodiscard]] auto next_deadline(Timestamp now) const -> Timestamp {
+		return count ? pending[first].deadline : now + kev::NO_DEADLINE;
+	}
+
+	[[nodiscard]] auto outstanding() const -> uint8_t { return count; }
+	[[nodiscard]] auto timeouts() const -> uint16_t { return timeout_count; }
+	[[nodiscard]] auto dropped() const -> uint16_t { return dropped_count; }
+	[[nodiscard]] auto lost() const -> uint16_t { return lost_count; }
+
+   private:
+	struct Pending {
+		TagT tag;
+		NexReply expect;
+		Timestamp deadline;
+	};
+
+	// Events (touch, page, position, sleep...) are never replies
+	static auto is_reply(NexFrame frame) -> bool {
+		switch (frame.head()) {
+		case NEX_RET_CMD_FINISHED:
+		case NEX_RET_NUMBER_HEAD:
+		case NEX_RET_STRING_HEAD: return true;
+		default: return frame.size == 1 && frame.head() <= 0x24;
+		}
+	}
+
+	static auto data_reply(NexFrame frame) -> NexReply {
+		switch (frame.head()) {
+		case NEX_RET_NUMBER_HEAD: return NexReply::NUMBER;
+		case NEX_RET_STRING_HEAD: return NexReply::STRING;
+		default: return NexReply::NONE;
+		}
+	}
+
+	auto pop() -> void {
+		first = (first + 1) % Depth;
+		--count;
+	}
+
+	SerialT& serial;
+	Duration timeout;
+	Pending pending[Depth] = {};
+	uint8_t first = 0;
+	uint8_t count = 0;
+	uint16_t timeout_count = 0;
+	uint16_t dropped_count = 0;
+	uint16_t lost_count = 0;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include "Flash.h"
+
+// Remembers a hash of the last value sent to each component of the current
+// page, so unchanged values are not sent again. The display forgets nothing
+// while the page stays up, so it must be cleared whenever the page changes.
+template <uint8_t Capacity = 8>
+struct NexShadow {
+	[[nodiscard]] auto changed(kev::FlashString id, uint32_t hash) const
+		-> bool {
+		auto const* entry = find(id);
+		return !entry || entry->hash != hash;
+	}
+
+	auto store(kev::FlashString id, uint32_t hash) -> void {
+		auto* entry = find(id);
+		if (!entry) {
+			if (count == Capacity)
+				return;
+			entry = &entries[count++];
+			entry->id = id;
+		}
+		entry->hash = hash;
+	}
+
+	// The next value for `id` is sent whatever it is, for when the display
+	// may show something else than was sent
+	auto forget(kev::FlashString id) -> void {
+		if (auto* entry = find(id))
+			*entry = entries[--count];
+	}
+
+	auto clear() -> void { count = 0; }
+
+   private:
+	struct Entry {
+		kev::FlashString id;
+		uint32_t hash;
+	};
+
+	auto find(kev::FlashString id) const -> Entry const* {
+		for (uint8_t i = 0; i < count; ++i) {
+			if (kev::flash_equal(entries[i].id, id))
+				return &entries[i];
+		}
+		return nullptr;
+	}
+
+	auto find(kev::FlashString id) -> Entry* {
+		auto const* self = this;
+		return const_cast<Entry*>(self->find(id));
+	}
+
+	Entry entries[Capacity] = {};
+	uint8_t count = 0;
+};
@@ -2,27 +2,118 @@
 
 #include <stdint.h>
 #include "Arduino.h"
+#include "NexHardware.h"
 
-template <class SerialT>
-auto receiveRaw(SerialT& serial, int timeout = 1000) -> String {
-	auto const initial = static_cast<long long>(millis());
-	auto s = String{};
-	auto consecutiveFF = 0;
-
-	while (millis() - initial < timeout) {
-		while (serial.available()) {
-			auto const b = serial.read();
-			s.concat((char)b);
-			if (static_cast<uint8_t>(b) == 0xFF) {
-				consecutiveFF++;
-			} else {
-				consecutiveFF = 0;
-			}
-			if (consecutiveFF >= 3) {
-				return s;
+// A complete frame as received from the display, without the 0xFF 0xFF 0xFF
+// terminator
+struct NexFrame {
+	uint8_t const* data;
+	uint8_t size;
+
+	[[nodiscard]] auto head() const -> uint8_t { return size ? data[0] : 0; }
+	auto operator[](uint8_t i) const -> uint8_t {
+		return i < size ? data[i] : 0;
+	}
+};
+
+enum class NexParse {
+	PENDING,
+	FRAME,
+	ERROR,
+};
+
+// Byte driven frame parser. Never waits: feed it whatever the serial port
+// already holds and it reports when a frame is finished. Frames with a known
+// length are cut by length, so payload bytes equal to 0xFF (e.g. in a 0x71
+// number) are not mistaken for the terminator.
+template <uint8_t Capacity = 32>
+struct NextionParser {
+	auto feed(uint8_t b) -> NexParse {
+		if (ready) {
+			ready = false;
+			size = 0;
+		}
+
+		consecutive_ff = b == 0xFF ? consecutive_ff + 1 : 0;
+
+		if (discarding) {
+			if (consecutive_ff >= 3) {
+				discarding = false;
+				consecutive_ff = 0;
 			}
+			return NexParse::PENDING;
+		}
+
+		if (size == 0) {
+			expected = frame_length(b);
+		}
+		if (size == Capacity) {
+			return fail();
 		}
+		buffer[size++] = b;
+
+		if (expected != 0) {
+			if (size < expected)
+				return NexParse::PENDING;
+			if (!terminated())
+				return fail();
+			return finish();
+		}
+
+		if (consecutive_ff >= 3) {
+			return finish();
+		}
+		return NexParse::PENDING;
+	}
+
+	// Valid after feed() returned FRAME. After ERROR it holds the bytes that
+	// were dropped, for logging.
+	[[nodiscard]] auto frame() const -> NexFrame {
+		return {buffer, frame_size};
+	}
+
+	[[nodiscard]] auto errors() const -> uint16_t { return error_count; }
+
+   private:
+	// Total length including terminator, 0 when only the terminator tells
+	static auto frame_length(uint8_t head) -> uint8_t {
+		switch (head) {
+		case NEX_RET_CURRENT_PAGE_ID_HEAD: return 5;
+		case NEX_RET_EVENT_TOUCH_HEAD: return 7;
+		case NEX_RET_NUMBER_HEAD: return 8;
+		case NEX_RET_EVENT_POSITION_HEAD:
+		case NEX_RET_EVENT_SLEEP_POSITION_HEAD: return 9;
+		default: return 0;
+		}
+	}
+
+	auto terminated() const -> bool {
+		return size >= 3 && buffer[size - 1] == 0xFF &&
+			   buffer[size - 2] == 0xFF && buffer[size - 3] == 0xFF;
+	}
+
+	auto finish() -> NexParse {
+		ready = true;
+		frame_size = size - 3;
+		consecutive_ff = 0;
+		return NexParse::FRAME;
+	}
+
+	// Hand out what was collected and drop input up to the next terminator
+	auto fail() -> NexParse {
+		++error_count;
+		ready = true;
+		frame_size = size;
+		discarding = true;
+		return NexParse::ERROR;
 	}
 
-	return s;
-}
+	uint8_t buffer[Capacity] = {};
+	uint8_t size = 0;
+	uint8_t frame_size = 0;
+	uint8_t expected = 0;
+	uint8_t consecutive_ff = 0;
+	uint16_t error_count = 0;
+	bool ready = false;
+	bool discarding = false;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include "Log.h"
+
+namespace kev {
+
+// Actuator changes made during a pass of the main loop are kept in a shadow
+// of each port and reach the pins together in commit(), one store per port
+// that changed. Every pump and valve switched by the same decision moves at
+// the same time, a port is written once however many of its pins changed,
+// and what the actuators are told is all in one place.
+//
+// Only bits of staged outputs are stored, other pins on the same port (the
+// LED, the pull-ups of the level sensors) keep what they had.
+struct OutputStage {
+	// Port ids as the Arduino core numbers them, 1 for A to 12 for L
+	static constexpr uint8_t PORTS = 13;
+
+	// Called once by each StagedOutput, before the loop starts
+	auto claim(uint8_t port, uint8_t mask, bool level) -> void {
+		owned[port] |= mask;
+		put(port, mask, level);
+		commit();
+	}
+
+	auto put(uint8_t port, uint8_t mask, bool level) -> void {
+		auto const bits = level ? shadow[port] | mask : shadow[port] & ~mask;
+		if (bits == shadow[port])
+			return;
+		shadow[port] = static_cast<uint8_t>(bits);
+		dirty |= static_cast<uint16_t>(1u << port);
+	}
+
+	[[nodiscard]] auto level(uint8_t port, uint8_t mask) const -> bool {
+		return shadow[port] & mask;
+	}
+
+	// At the end of each pass, with interrupts off so none of them sees
+	// some ports changed and not the others. Leaves the pins alone when
+	// nothing changed.
+	auto commit() -> void {
+		if (!dirty)
+			return;
+		auto const sreg = SREG;
+		cli();
+		for (uint8_t port = 0; dirty; ++port) {
+			auto const bit = static_cast<uint16_t>(1u << port);
+			if (!(dirty & bit))
+				continue;
+			dirty &= ~bit;
+			++stores;
+
+			auto* reg = portOutputRegister(port);
+			*reg = static_cast<uint8_t>((*reg & ~owned[port]) |
+										(shadow[port] & owned[port]));
+		}
+		SREG = sreg;
+	}
+
+	// "Outputs A = 2A, C = 54, ..., port stores = 12", levels as on the pins
+	template <class LogT>
+	auto report(LogT& log) -> void {
+		log.partial_start();
+		log.partial(TOK("Outputs"));
+		auto first = true;
+		for (uint8_t port = 0; port < PORTS; ++port) {
+			if (!owned[port])
+				continue;
+			log.partial(first ? TOK(" ") : TOK(", "),
+						static_cast<char>('A' + port - 1), TOK(" = "),
+						Hex{static_cast<uint8_t>(shadow[port] & owned[port])});
+			first = false;
+		}
+		log.partial(TOK(", port stores = "), stores);
+		log.partial_end();
+	}
+
+   private:
+	uint8_t shadow[PORTS] = {};
+	// Bits of staged outputs, commit() stores only these
+	uint8_t owned[PORTS] = {};
+	// One bit per port with changes not yet on the pins
+	uint16_t dirty = 0;
+	unsigned long stores = 0;
+};
+
+// An output pin written through an OutputStage, used like a DirectIO
+// Output: assign true or false, read back what was last assigned. ActiveLow
+// pins are on when the pin is low, the way OutputLow drives the relays.
+template <uint8_t Pin, bool ActiveLow = false>
+struct StagedOutput {
+	// Off from the start, as DirectIO outputs are
+	StagedOutput(OutputStage& stage)
+		: stage{stage},
+		  port{digitalPinToPort(Pin)},
+		  mask{digitalPinToBitMask(Pin)} {
+		stage.claim(port, mask, ActiveLow);
+		pinMode(Pin, OUTPUT);
+	}
+
+	auto operator=(bool value) -> StagedOutput& {
+		stage.put(port, mask, value != ActiveLow);
+		return *this;
+	}
+
+	[[nodiscard]] auto read() const -> bool {
+		return stage.level(port, mask) != ActiveLow;
+	}
+	operator bool() const { return read(); }
+
+   private:
+	OutputStage& stage;
+	uint8_t port;
+	uint8_t mask;
+};
+
+template <uint8_t Pin>
+using StagedOutputLow = StagedOutput<Pin, true>;
+
+}  // namespace kev
@@ -1,14 +1,154 @@
 #pragma once
 
+#include <Arduino.h>
 #include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <string.h>
+#include "Hash.h"
+#include "SpscQueue.h"
 
-template <int address>
-struct PersistByte {
-	auto save(uint8_t b) -> void {
-		eeprom_write_byte(reinterpret_cast<uint8_t*>(address), b);
+namespace kev {
+
+// Writes EEPROM bytes from ISR(EE_READY_vect), one per interrupt, so the
+// loop never waits the ~3.4 ms each byte takes
+struct EepromWriter {
+	struct Byte {
+		uint16_t address;
+		uint8_t value;
+	};
+
+	static constexpr uint8_t DEPTH = 32;
+
+	// Either all `n` bytes starting at `address` are queued or none are
+	auto write(uint16_t address, uint8_t const* data, uint8_t n) -> bool {
+		if (n > space())
+			return false;
+		for (uint8_t i = 0; i < n; ++i)
+			bytes.push({static_cast<uint16_t>(address + i), data[i]});
+		queued += n;
+		EECR |= _BV(EERIE);
+		return true;
+	}
+
+	// From ISR(EE_READY_vect) only
+	auto pump() -> void {
+		auto b = Byte{};
+		if (!bytes.pop(b)) {
+			EECR &= ~_BV(EERIE);
+			return;
+		}
+		eeprom_write_byte(reinterpret_cast<uint8_t*>(b.address), b.value);
+		++written;
 	}
 
-	auto read() -> uint8_t {
-		return eeprom_read_byte(reinterpret_cast<uint8_t*>(address));
+	[[nodiscard]] auto space() const -> uint8_t {
+		return DEPTH - static_cast<uint8_t>(queued - written);
 	}
+
+   private:
+	SpscQueue<Byte, DEPTH> bytes;
+	// Only the loop writes `queued` and only the ISR writes `written`
+	uint8_t queued = 0;
+	uint8_t volatile written = 0;
 };
+
+inline auto eeprom_writer = EepromWriter{};
+
+// Keeps a value in EEPROM as a journal of records spread round-robin over
+// Slots slots starting at Base, so each cell takes 1/Slots of the writes.
+// A record is a 16 bit sequence number, the value and a CRC-8; read()
+// returns the valid record with the newest sequence number, so a write cut
+// short by a reset leaves the previous one in place.
+template <class T, uint16_t Base, uint8_t Slots>
+struct EepromJournal {
+	static constexpr uint8_t RECORD_SIZE = 2 + sizeof(T) + 1;
+	static_assert(Base + Slots * uint16_t{RECORD_SIZE} <= E2END + 1,
+				  "Journal does not fit in the EEPROM");
+
+	// False when there is no valid record yet
+	auto read(T& value) -> bool {
+		scan();
+		if (found)
+			value = newest;
+		return found;
+	}
+
+	// Queues the record; when the writer is full it is retried from flush()
+	auto save(T const& value) -> void {
+		scan();
+		staged = value;
+		dirty = true;
+		flush();
+	}
+
+	// Retries a save the writer had no room for
+	auto flush() -> void {
+		if (!dirty)
+			return;
+
+		uint8_t record[RECORD_SIZE];
+		record[0] = static_cast<uint8_t>(seq);
+		record[1] = static_cast<uint8_t>(seq >> 8);
+		memcpy(record + 2, &staged, sizeof(T));
+		record[RECORD_SIZE - 1] = crc(record);
+
+		if (!eeprom_writer.write(address(slot), record, RECORD_SIZE)) {
+			++deferred_count;
+			return;
+		}
+		dirty = false;
+		++seq;
+		slot = (slot + 1) % Slots;
+	}
+
+	[[nodiscard]] auto deferred() const -> uint16_t { return deferred_count; }
+
+   private:
+	static constexpr auto address(uint8_t slot) -> uint16_t {
+		return Base + slot * uint16_t{RECORD_SIZE};
+	}
+
+	static auto crc(uint8_t const* record) -> uint8_t {
+		auto c = Crc8{};
+		for (uint8_t i = 0; i < RECORD_SIZE - 1; ++i)
+			c.add(record[i]);
+		return c.value;
+	}
+
+	// Finds the newest valid record, and with it where the next one goes
+	auto scan() -> void {
+		if (scanned)
+			return;
+		scanned = true;
+
+		for (uint8_t s = 0; s < Slots; ++s) {
+			uint8_t record[RECORD_SIZE];
+			eeprom_read_block(record, reinterpret_cast<void const*>(address(s)),
+							  RECORD_SIZE);
+			if (crc(record) != record[RECORD_SIZE - 1])
+				continue;
+
+			auto const record_seq =
+				static_cast<uint16_t>(record[0] | (record[1] << 8));
+			// Sequence numbers wrap, compare them by distance
+			if (found && static_cast<int16_t>(record_seq - (seq - 1)) <= 0)
+				continue;
+
+			found = true;
+			memcpy(&newest, record + 2, sizeof(T));
+			seq = record_seq + 1;
+			slot = (s + 1) % Slots;
+		}
+	}
+
+	T newest = {};
+	T staged = {};
+	uint16_t seq = 0;
+	uint16_t deferred_count = 0;
+	uint8_t slot = 0;
+	bool scanned = false;
+	bool found = false;
+	bool dirty = false;
+};
+
+}  // namespace kev
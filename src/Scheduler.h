@@ -0,0 +1,191 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "Clock.h"
+#include "Idle.h"
+#include "Log.h"
+#include "Stats.h"
+#include "Time.h"
+#include "Timer.h"
+
+namespace kev {
+
+enum class TaskPriority : uint8_t {
+	// Runs every time it is due, before anything else
+	CONTROL,
+	UI,
+	BACKGROUND,
+
+	LAST,
+};
+
+using TaskFn = void (*)(Timestamp now);
+// When a task that runs every pass next has work, see Scheduler::idle()
+using DeadlineFn = Timestamp (*)(Timestamp now);
+
+struct Task {
+	Task(LogText name,
+		 TaskFn fn,
+		 Duration period,
+		 TaskPriority priority,
+		 unsigned long budget_us,
+		 DeadlineFn deadline = nullptr)
+		: name{name},
+		  fn{fn},
+		  deadline{deadline},
+		  priority{priority},
+		  budget_us{budget_us},
+		  timer{period},
+		  every_pass{period == 0_ms} {}
+
+	LogText name;
+	TaskFn fn;
+	DeadlineFn deadline;
+	TaskPriority priority;
+	// Expected worst case, longer runs count as overruns
+	unsigned long budget_us;
+
+	Timer timer;
+	bool every_pass;
+	bool deferred_last = false;
+	uint16_t overruns = 0;
+	uint16_t deferrals = 0;
+	LatencyStats stats;
+};
+
+// Runs a static table of tasks from the main loop. Each pass goes through the
+// priorities in order. CONTROL tasks always run when due; the others only
+// while the pass is expected to stay within pass_budget_us, but a task is
+// never deferred twice in a row so it cannot starve.
+//
+// Between passes idle() sleeps until the next task is due. Periodic tasks
+// are due when their timer runs out; tasks that run every pass need a
+// DeadlineFn, without one the loop never sleeps.
+template <uint8_t N>
+struct Scheduler {
+	auto run(Timestamp now) -> void {
+		auto const pass_start = Clock::ticks_us();
+		auto const woken = slept;
+		slept = false;
+
+		for (uint8_t p = 0; p < static_cast<uint8_t>(TaskPriority::LAST); ++p) {
+			for (auto& task : tasks) {
+				if (static_cast<uint8_t>(task.priority) != p || !due(task, now))
+					continue;
+
+				auto const spent = Clock::ticks_us() - pass_start;
+				if (task.priority != TaskPriority::CONTROL &&
+					!task.deferred_last &&
+					spent + task.budget_us > pass_budget_us) {
+					task.deferred_last = true;
+					++task.deferrals;
+					continue;
+				}
+
+				run_task(task, now);
+			}
+		}
+
+		pass_stats.record(Clock::ticks_us() - pass_start, now);
+		if (woken)
+			wake_stats.record(Clock::ticks_us() - wake_start, now);
+	}
+
+	auto next_deadline(Timestamp now) -> Timestamp {
+		auto deadline = now + NO_DEADLINE;
+		for (auto& task : tasks) {
+			if (task.deferred_last)
+				return now;
+			if (!task.every_pass)
+				deadline = earliest(now, deadline, task.timer.deadline());
+			else if (task.deadline)
+				deadline = earliest(now, deadline, task.deadline(now));
+			else
+				return now;
+		}
+		return deadline;
+	}
+
+	// Sleeps until the next task is due or has_work() turns true, see
+	// idle_until()
+	template <class WakeFn>
+	auto idle(WakeFn has_work) -> void {
+		auto const now = Clock::now();
+		auto const deadline = next_deadline(now);
+		if ((deadline - now) <= Duration{0})
+			return;
+
+		auto const start = Clock::ticks_us();
+		idle_until(deadline, has_work);
+		wake_start = Clock::ticks_us();
+		idle_stats.record(wake_start - start, now);
+		slept = true;
+	}
+
+	auto reset() -> void {
+		for (auto& task : tasks) {
+			task.stats.reset();
+			task.overruns = 0;
+			task.deferrals = 0;
+		}
+		pass_stats.reset();
+		idle_stats.reset();
+		wake_stats.reset();
+	}
+
+	// One line per task, then the whole pass, sleeping and waking up
+	static constexpr auto report_lines() -> uint8_t { return N + 3; }
+
+	template <class LogT>
+	auto report(LogT& log, uint8_t line) -> void {
+		log.partial_start();
+		if (line < N) {
+			auto& task = tasks[line];
+			log.partial(task.name, TOK(" budget="), task.budget_us,
+						TOK("us overruns="), task.overruns, TOK(" deferrals="),
+						task.deferrals);
+			task.stats.report(log);
+		} else if (line == N) {
+			log.partial(TOK("pass budget="), pass_budget_us, TOK("us"));
+			pass_stats.report(log);
+		} else if (line == N + 1) {
+			log.partial(TOK("idle"));
+			idle_stats.report(log);
+		} else {
+			// From leaving sleep to the end of the pass that followed
+			log.partial(TOK("wake"));
+			wake_stats.report(log);
+		}
+		log.partial_end();
+	}
+
+	Task tasks[N];
+	unsigned long pass_budget_us;
+	LatencyStats pass_stats = {};
+	// How long each idle() slept
+	LatencyStats idle_stats = {};
+	LatencyStats wake_stats = {};
+	// Kept public so the scheduler stays an aggregate, for idle() only
+	bool slept = false;
+	unsigned long wake_start = 0;
+
+   private:
+	static auto due(Task& task, Timestamp now) -> bool {
+		return task.every_pass || task.timer.isDone(now);
+	}
+
+	static auto run_task(Task& task, Timestamp now) -> void {
+		auto const start = Clock::ticks_us();
+		task.fn(now);
+		auto const took = Clock::ticks_us() - start;
+
+		task.timer.reset(now);
+		task.deferred_last = false;
+		task.stats.record(took, now);
+		if (took > task.budget_us)
+			++task.overruns;
+	}
+};
+
+}  // namespace kev
@@ -1,57 +1,94 @@
 #pragma once
 
-template <class WrappedT>
+#include <Arduino.h>
+#include <stdint.h>
+#include "Clock.h"
+#include "Log.h"
+#include "Time.h"
+
+// An output driven by up to 8 consumers at once, on while any of them asks
+// for it. Each consumer owns one bit of a mask, so a request sets or clears
+// its bit and the pin follows with a single compare, however many share it.
+//
+// Consumers get a Handle<I> from handle<I>() and assign it like a plain
+// output. How long each one kept the output on is counted for report().
+template <class WrappedT, uint8_t N>
 struct SharedOutput {
+	static_assert(N > 0 && N <= 8, "One bit per consumer in a uint8_t");
+
+	template <uint8_t I>
+	struct Handle {
+		static_assert(I < N, "No such consumer");
+
+		auto operator=(bool value) -> Handle& {
+			shared.set(I, value);
+			return *this;
+		}
+
+		[[nodiscard]] auto read() const -> bool { return shared.read(I); }
+		explicit operator bool() const { return read(); }
+
+		SharedOutput& shared;
+	};
+
 	SharedOutput(WrappedT& output) : output{output} {}
 
-	auto set_a(bool out) {
-		out_a = out;
-		update();
+	template <uint8_t I>
+	auto handle() -> Handle<I> {
+		return Handle<I>{*this};
 	}
 
-	auto set_b(bool out) {
-		out_b = out;
-		update();
+	[[nodiscard]] auto read(uint8_t consumer) const -> bool {
+		return requests & bit(consumer);
 	}
 
-	[[nodiscard]] auto read_a() const -> bool { return out_a; }
-	[[nodiscard]] auto read_b() const -> bool { return out_b; }
+	// One bit per consumer asking for the output now
+	[[nodiscard]] auto holders() const -> uint8_t { return requests; }
 
-   private:
-	auto update() -> void { output = out_a || out_b; }
-	bool out_a = false;
-	bool out_b = false;
-	WrappedT& output;
-};
-
-template <class SharedT>
-struct SharedOutputA {
-	SharedOutputA(SharedT& shared) : shared{shared} {}
-
-	auto operator=(bool value) -> SharedOutputA& {
-		shared.set_a(value);
-		return *this;
+	// Every period `consumer` held the output on, the current one included
+	[[nodiscard]] auto on_time(uint8_t consumer, kev::Timestamp now) const
+		-> kev::Duration {
+		auto total = kev::Duration{static_cast<long>(on_ms[consumer])};
+		if (read(consumer))
+			total = total + (now - since[consumer]);
+		return total;
 	}
 
-	[[nodiscard]] auto read() const -> bool { return shared.read_a(); }
-	explicit operator bool() const { return shared.read_a(); }
+	// "<name> on time s = 12* 0", * marks who holds it now
+	template <class LogT>
+	auto report(LogT& log, kev::LogText name, kev::Timestamp now) -> void {
+		log.partial_start();
+		log.partial(name, TOK(" on time s ="));
+		for (uint8_t i = 0; i < N; ++i) {
+			log.partial(' ', on_time(i, now).unsafeGetValue() / 1000);
+			if (read(i))
+				log.partial('*');
+		}
+		log.partial_end();
+	}
 
    private:
-	SharedT& shared;
-};
+	static constexpr auto bit(uint8_t consumer) -> uint8_t {
+		return static_cast<uint8_t>(1u << consumer);
+	}
 
-template <class SharedT>
-struct SharedOutputB {
-	SharedOutputB(SharedT& shared) : shared{shared} {}
+	auto set(uint8_t consumer, bool on) -> void {
+		if (on == read(consumer))
+			return;
 
-	auto operator=(bool value) -> SharedOutputB& {
-		shared.set_b(value);
-		return *this;
+		auto const now = kev::Clock::now();
+		if (on) {
+			requests |= bit(consumer);
+			since[consumer] = now;
+		} else {
+			requests &= ~bit(consumer);
+			on_ms[consumer] += (now - since[consumer]).unsafeGetValue();
+		}
+		output = requests != 0;
 	}
 
-	[[nodiscard]] auto read() const -> bool { return shared.read_b(); }
-	explicit operator bool() const { return shared.read_b(); }
-
-   private:
-	SharedT& shared;
+	WrappedT& output;
+	uint8_t requests = 0;
+	kev::Timestamp since[N] = {};
+	unsigned long on_ms[N] = {};
 };
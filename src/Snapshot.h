@@ -0,0 +1,116 @@
+#pragma once
+
+#include <avr/eeprom.h>
+#include "AqueductSM.h"
+#include "Log.h"
+#include "Persist.h"
+#include "TankSM.h"
+#include "Tanks.h"
+#include "Timer.h"
+
+using namespace kev::literals;
+using kev::Timer;
+using kev::Timestamp;
+
+// Everything needed to carry on after a reset. With two tanks the layout is
+// the one older versions saved.
+template <uint8_t N>
+struct PlantSnapshot {
+	TankSnapshot tanks[N];
+	uint8_t aqueduct;
+	// 0 when free, otherwise 1 + index of the tank in IN_PROCESS
+	uint8_t in_process_owner;
+};
+
+// Saves a PlantSnapshot whenever a state machine changes state, and every
+// SAVE_PERIOD while a tank timer runs. After a power loss restore() resumes
+// every machine from it, repeating at most SAVE_PERIOD of a timed phase.
+template <class TanksT, class AqueductSM, class JournalT>
+struct PlantPersist {
+	using Snapshot = PlantSnapshot<TanksT::SIZE>;
+	static constexpr auto SAVE_PERIOD = 1_min;
+
+	PlantPersist(TanksT& tanks, AqueductSM& aqueduct_sm, JournalT& journal)
+		: tanks{tanks}, aqueduct_sm{aqueduct_sm}, journal{journal} {}
+
+	auto restore(Timestamp now) -> void {
+		auto snap = Snapshot{};
+		if (!journal.read(snap)) {
+			// Single bytes at 0 and 1 are where the states of the first two
+			// tanks used to be
+			log(TOK("No snapshot, reading the old tank state cells"));
+			for (uint8_t i = 0; i < TanksT::SIZE && i < 2; ++i)
+				snap.tanks[i].state = eeprom_read_byte(legacy_cell(i));
+		}
+
+		// The owner goes first so it gets the in-process line back
+		auto const owner = snap.in_process_owner;
+		if (owner > 0 && owner <= TanksT::SIZE) {
+			tanks.visit(owner - 1, [&](auto& sm) {
+				sm.resume(snap.tanks[owner - 1], now);
+			});
+		}
+		tanks.for_each([&](uint8_t i, auto& sm) {
+			if (i + 1 != owner)
+				sm.resume(snap.tanks[i], now);
+		});
+		aqueduct_sm.resume(static_cast<AqState>(snap.aqueduct));
+
+		saved = take(now);
+		save_timer.reset(now);
+	}
+
+	auto tick(Timestamp now) -> void {
+		auto const snap = take(now);
+		if (!same_states(snap, saved) ||
+			(timing(snap) && save_timer.isDone(now))) {
+			journal.save(snap);
+			saved = snap;
+			save_timer.reset(now);
+		}
+		// Retries a save the EEPROM writer had no room for
+		journal.flush();
+	}
+
+   private:
+	static auto legacy_cell(uintptr_t address) -> uint8_t const* {
+		return reinterpret_cast<uint8_t const*>(address);
+	}
+
+	auto take(Timestamp now) -> Snapshot {
+		auto snap = Snapshot{};
+		tanks.for_each([&](uint8_t i, auto& sm) {
+			snap.tanks[i] = sm.snapshot(now);
+			if (!snap.in_process_owner &&
+				sm.get_state() == TankState::IN_PROCESS) {
+				snap.in_process_owner = i + 1;
+			}
+		});
+		snap.aqueduct = static_cast<uint8_t>(aqueduct_sm.get_state());
+		return snap;
+	}
+
+	static auto same_states(Snapshot const& a, Snapshot const& b) -> bool {
+		for (uint8_t i = 0; i < TanksT::SIZE; ++i) {
+			if (a.tanks[i].state != b.tanks[i].state)
+				return false;
+		}
+		return a.aqueduct == b.aqueduct;
+	}
+
+	static auto timing(Snapshot const& snap) -> bool {
+		for (auto const& tank : snap.tanks) {
+			if (tank.elapsed_s)
+				return true;
+		}
+		return false;
+	}
+
+	TanksT& tanks;
+	AqueductSM& aqueduct_sm;
+	JournalT& journal;
+
+	Snapshot saved = {};
+	Timer save_timer{SAVE_PERIOD};
+	Log<> log{TOK("persist")};
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace kev {
+
+// Lock-free queue between one producer (usually an ISR) and one consumer
+// (the loop). Each side only writes its own index, and single byte loads and
+// stores are atomic on AVR, so neither side needs to disable interrupts.
+template <class T, uint8_t Size>
+struct SpscQueue {
+	static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+	// Producer side. False when full, the item is dropped.
+	auto push(T const& item) -> bool {
+		auto const h = head;
+		if (static_cast<uint8_t>(h - tail) == Size)
+			return false;
+		items[h & (Size - 1)] = item;
+		barrier();
+		head = h + 1;
+		return true;
+	}
+
+	// Consumer side. False when empty.
+	auto pop(T& item) -> bool {
+		auto const t = tail;
+		if (t == head)
+			return false;
+		item = items[t & (Size - 1)];
+		barrier();
+		tail = t + 1;
+		return true;
+	}
+
+	[[nodiscard]] auto empty() const -> bool { return head == tail; }
+
+   private:
+	// Keeps the compiler from moving item copies past the index updates
+	static auto barrier() -> void { __asm__ __volatile__("" ::: "memory"); }
+
+	T items[Size] = {};
+	uint8_t volatile head = 0;
+	uint8_t volatile tail = 0;
+};
+
+}  // namespace kev
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "Log.h"
+#include "Time.h"
+
+namespace kev {
+
+// Execution time of one piece of the main loop, measured with micros()
+struct LatencyStats {
+	// Bucket i counts durations below 2^(i+1) us, the last one everything
+	// from 2^(BUCKETS-1) us (~0.5 s) up
+	static constexpr uint8_t BUCKETS = 20;
+
+	auto record(unsigned long us, Timestamp now) -> void {
+		uint8_t bucket = 0;
+		for (auto v = us >> 1; v && bucket < BUCKETS - 1; v >>= 1)
+			++bucket;
+		if (histogram[bucket] != UINT16_MAX)
+			++histogram[bucket];
+
+		if (count == 0 || us < min_us)
+			min_us = us;
+		if (count == 0 || us > max_us) {
+			max_us = us;
+			worst_at = now;
+		}
+		last_us = us;
+		++count;
+	}
+
+	auto reset() -> void { *this = LatencyStats{}; }
+
+	// Goes between log.partial_start() and log.partial_end()
+	template <class LogT>
+	auto report(LogT& log) -> void {
+		log.partial(TOK(" n="), count, TOK(" last/min/max="), last_us, '/',
+					min_us, '/', max_us, TOK("us worst@"),
+					worst_at.unsafeGetValue(), TOK("ms hist"));
+		for (uint8_t i = 0; i < BUCKETS; ++i) {
+			if (histogram[i])
+				log.partial(TOK(" <"), 2ul << i, ':', histogram[i]);
+		}
+	}
+
+	uint16_t histogram[BUCKETS] = {};
+	unsigned long count = 0;
+	unsigned long min_us = 0;
+	unsigned long max_us = 0;
+	unsigned long last_us = 0;
+	Timestamp worst_at = {};
+};
+
+}  // namespace kev
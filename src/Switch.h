@@ -0,0 +1,17 @@
+#pragma once
+
+namespace kev {
+
+// A pump or a valve connected to nothing: it only keeps the value last
+// written. Stands in for the pins wherever a state machine runs without the
+// plant, in the tests, bench/ and tools/plantsim.
+struct Switch {
+	auto operator=(bool value) -> Switch& {
+		on = value;
+		return *this;
+	}
+	operator bool() const { return on; }
+	bool on = false;
+};
+
+}  // namespace kev
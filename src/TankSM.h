@@ -1,12 +1,13 @@
 #pragma once
 #include <Arduino.h>
-#include "Edge.h"
+#include "Fsm.h"
+#include "InputDebouncer.h"
+#include "IoRef.h"
 #include "Log.h"
-#include "Mutex.h"
+#include "Arbiter.h"
 #include "Timer.h"
 
 using namespace kev::literals;
-using kev::EdgeDebounced;
 using kev::Timer;
 using kev::Timestamp;
 
@@ -15,7 +16,7 @@ constexpr auto TIME_FILL_FAILSAFE = 27_min;
 constexpr auto TIME_CHEM1 = 40_min;
 constexpr auto TIME_CHEM2 = 5_min;
 
-enum struct TankState {
+enum struct TankState : uint8_t {
 	INITIAL,
 	PRE_FILL,
 	FILLING,
@@ -29,333 +30,414 @@ enum struct TankState {
 	LAST,
 };
 
-template <class OutFillPump,
-		  class OutRecirPump,
-		  class OutIngressValve,
-		  class OutProcessValve,
-		  class InSensorHi,
-		  class InAqSensorLo,
-		  class StateSaver>
+enum struct TankEvent : uint8_t {
+	NEXT,
+	CANCEL,
+	FORCE_NEXT,
+	FORCE_PREV,
+	FILL_FINISH,
+	// The timer of the current state ran out
+	TIMEOUT,
+	SENSOR_HI,
+	// The fill pump or the in-process line this tank waited for is free
+	GRANTED,
+
+	LAST,
+};
+
+// What a tank needs to carry on after a restart
+struct TankSnapshot {
+	uint8_t state;
+	// Of the timer running in that state, if any
+	uint16_t elapsed_s;
+};
+
+// One class for every tank: the pins are bound at construction through
+// kev::OutputRef and kev::DebouncedInput, so the state machine, its table and
+// its strings are in flash once however many tanks there are. The level
+// sensors are debounced together with every other input by the
+// kev::InputDebouncer they come from.
 struct TankSM {
-	TankSM(char const* name,
+	using Fsm = kev::Fsm<TankSM, TankState, TankEvent>;
+
+	template <class OutFillPump,
+			  class OutRecirPump,
+			  class OutIngressValve,
+			  class OutProcessValve>
+	TankSM(kev::LogText name,
 		   OutFillPump& out_fill_pump,
 		   OutRecirPump& out_recir_pump,
 		   OutIngressValve& out_ingress_valve,
 		   OutProcessValve& out_process_valve,
-		   InSensorHi& in_sensor_hi,
-		   InAqSensorLo& in_aq_sensor_lo,
-		   StateSaver& state_saver,
-		   Mutex& in_process_mutex)
+		   kev::DebouncedInput in_sensor_hi,
+		   kev::DebouncedInput in_aq_sensor_lo,
+		   kev::Arbiter::Handle fill_line,
+		   kev::Arbiter::Handle in_process)
 		: log{name},
-		  out_fill_pump{out_fill_pump},
-		  out_recir_pump{out_recir_pump},
-		  out_ingress_valve{out_ingress_valve},
-		  out_process_valve{out_process_valve},
-		  in_sensor_hi_edge{in_sensor_hi, 5_s},
-		  in_aq_sensor_lo_edge{in_aq_sensor_lo, 5_s},
-		  state_saver{state_saver},
-		  in_process_mutex{in_process_mutex} {}
-
-	auto event_next() -> void {
-		switch (state) {
-		case TankState::INITIAL: set_state(TankState::PRE_FILL); break;
-		case TankState::WAITING_CHEM_1: set_state(TankState::CHEM_1); break;
-		case TankState::WAITING_CHEM_2: set_state(TankState::CHEM_2); break;
-		case TankState::WAITING_IN_PROCESS:
-			set_state(TankState::IN_PROCESS);
-			break;
-		case TankState::IN_PROCESS: set_state(TankState::INITIAL); break;
-		default: log("Ignoring event_next in state ", state_text()); break;
-		}
-	}
-
+		  out_fill_pump{kev::OutputRef::of(out_fill_pump)},
+		  out_recir_pump{kev::OutputRef::of(out_recir_pump)},
+		  out_ingress_valve{kev::OutputRef::of(out_ingress_valve)},
+		  out_process_valve{kev::OutputRef::of(out_process_valve)},
+		  in_sensor_hi_edge{in_sensor_hi},
+		  in_aq_sensor_lo_edge{in_aq_sensor_lo},
+		  fill_line{fill_line},
+		  in_process{in_process} {}
+
+	auto event_next() -> void { event(TankEvent::NEXT); }
 	auto event_cancel() -> void {
-		switch (state) {
-		case TankState::PRE_FILL:
-		case TankState::FILLING: set_state(TankState::INITIAL); break;
-		case TankState::CHEM_1: set_state(TankState::WAITING_CHEM_1); break;
-		case TankState::CHEM_2: set_state(TankState::WAITING_CHEM_2); break;
-		case TankState::IN_PROCESS:
-			set_state(TankState::WAITING_IN_PROCESS);
-			break;
-		default: log("Ignoring event_cancel in state ", state_text()); break;
-		}
-	}
-
-	auto event_force_next_stage() -> void {
-		switch (state) {
-		case TankState::INITIAL: set_state(TankState::WAITING_CHEM_1); break;
-		case TankState::WAITING_CHEM_1:
-			set_state(TankState::WAITING_CHEM_2);
-			break;
-		case TankState::WAITING_CHEM_2:
-			set_state(TankState::WAITING_IN_PROCESS);
-			break;
-		case TankState::WAITING_IN_PROCESS:
-			set_state(TankState::INITIAL);
-			break;
-		default:
-			log("Ignoring event_force_next_stage in state ", state_text());
-			break;
+		// Waiting in line for the pump or IN_PROCESS is undone in place
+		if (get_state() == TankState::INITIAL && in_line(fill_line)) {
+			fill_line.release();
+			log(TOK("Left the fill line"));
+			return;
 		}
-	}
-
-	auto event_force_prev_stage() -> void {
-		switch (state) {
-		case TankState::INITIAL:
-			set_state(TankState::WAITING_IN_PROCESS);
-			break;
-		case TankState::WAITING_CHEM_1: set_state(TankState::INITIAL); break;
-		case TankState::WAITING_CHEM_2:
-			set_state(TankState::WAITING_CHEM_1);
-			break;
-		case TankState::WAITING_IN_PROCESS:
-			set_state(TankState::WAITING_CHEM_2);
-			break;
-		default:
-			log("Ignoring event_force_next_stage in state ", state_text());
-			break;
+		if (get_state() == TankState::WAITING_IN_PROCESS &&
+			in_line(in_process)) {
+			in_process.release();
+			log(TOK("Left the in-process line"));
+			return;
 		}
+		event(TankEvent::CANCEL);
 	}
+	auto event_force_next_stage() -> void { event(TankEvent::FORCE_NEXT); }
+	auto event_force_prev_stage() -> void { event(TankEvent::FORCE_PREV); }
+	auto event_fill_finish() -> void { event(TankEvent::FILL_FINISH); }
 
-	auto event_fill_finish() -> void {
-		if (state != TankState::FILLING) {
-			log("Ignoring fill finish event on state other than FILLING");
-			return;
+	auto tick(Timestamp now) -> void {
+		in_sensor_hi_edge.update();
+
+		// Before the entry actions, so the timers are reset before they are
+		// checked below
+		if (granted())
+			fsm.dispatch(*this, TankEvent::GRANTED);
+		fsm.tick(*this, now);
+
+		if (auto* timer = active_timer(); timer && timer->isDone(now)) {
+			if (get_state() == TankState::FILLING)
+				log(TOK("Alerta: Finalizando llenado por tiempo de seguridad"));
+			fsm.dispatch(*this, TankEvent::TIMEOUT);
+		} else if (in_sensor_hi_edge.risingEdge()) {
+			fsm.dispatch(*this, TankEvent::SENSOR_HI);
 		}
-
-		set_state(TankState::WAITING_CHEM_1);
 	}
 
-	auto tick(Timestamp now) -> void {
-		in_sensor_hi_edge.update(now);
+	// When tick() next has something to do
+	auto next_deadline(Timestamp now) -> Timestamp {
+		if (fsm.changed() || granted())
+			return now;
 
-		if (changed()) {
-			handle_state_changed(now);
-		}
-		state_transitions(now);
+		auto const sensor = in_sensor_hi_edge.next_deadline(now);
+		if (auto* timer = active_timer())
+			return kev::earliest(now, sensor, timer->deadline());
+		return sensor;
 	}
 
 	auto log_debug(Timestamp now) {
 		log.partial_start();
-		log.partial("State = ", state_text());
-		log.partial(", In: ", in_sensor_hi_edge.value() ? "HI " : "   ");
-		log.partial(in_aq_sensor_lo_edge.value() ? "LO " : "   ");
-		log.partial(", Out: ", out_fill_pump ? "FIL " : "    ",
-					out_ingress_valve ? "VAL " : "    ",
-					out_recir_pump ? "RCR " : "    ",
-					out_process_valve ? "PRO " : "    ");
-		if (state == TankState::PRE_FILL) {
-			log.partial(", Pre-fill timer = ", pre_fill_timer.elapsedSec(now),
-						"/", pre_fill_timer.totalSec());
+		log.partial(TOK("State = "), state_text());
+		log.partial(TOK(", In: "),
+					in_sensor_hi_edge.value() ? TOK("HI ") : TOK("   "));
+		log.partial(in_aq_sensor_lo_edge.value() ? TOK("LO ") : TOK("   "));
+		log.partial(TOK(", Out: "), out_fill_pump ? TOK("FIL ") : TOK("    "),
+					out_ingress_valve ? TOK("VAL ") : TOK("    "),
+					out_recir_pump ? TOK("RCR ") : TOK("    "),
+					out_process_valve ? TOK("PRO ") : TOK("    "));
+		if (get_state() == TankState::PRE_FILL) {
+			log.partial(TOK(", Pre-fill timer = "),
+						pre_fill_timer.elapsedSec(now), TOK("/"),
+						pre_fill_timer.totalSec());
 		}
-		if (state == TankState::FILLING) {
-			log.partial(", Fill failsafe = ", fill_timer.elapsedSec(now), "/",
-						fill_timer.totalSec());
+		if (get_state() == TankState::FILLING) {
+			log.partial(TOK(", Fill failsafe = "), fill_timer.elapsedSec(now),
+						TOK("/"), fill_timer.totalSec());
 		}
-		if (state == TankState::CHEM_1) {
-			log.partial(", Chem1 timer = ", chem1_timer.elapsedSec(now), "/",
-						chem1_timer.totalSec());
+		if (get_state() == TankState::CHEM_1) {
+			log.partial(TOK(", Chem1 timer = "), chem1_timer.elapsedSec(now),
+						TOK("/"), chem1_timer.totalSec());
 		}
-		if (state == TankState::CHEM_2) {
-			log.partial(", Chem2 timer = ", chem2_timer.elapsedSec(now), "/",
-						chem2_timer.totalSec());
+		if (get_state() == TankState::CHEM_2) {
+			log.partial(TOK(", Chem2 timer = "), chem2_timer.elapsedSec(now),
+						TOK("/"), chem2_timer.totalSec());
 		}
-		log.partial(", in_process_mutex = ",
-					in_process_mutex.current() ? "LOCKED " : "UNLOCKED ");
+		if (in_line(fill_line))
+			log.partial(TOK(", fill line = "), fill_line.position());
+		if (in_line(in_process))
+			log.partial(TOK(", in-process line = "), in_process.position());
 		log.partial_end();
 	}
 
-	auto display_fill_timer(Timestamp now) -> String {
-		if (state != TankState::FILLING)
-			return "N/A";
-		return format_timer(fill_timer, now);
+	template <class TextT>
+	auto display_fill_timer(Timestamp now, TextT& out) -> void {
+		if (get_state() != TankState::FILLING)
+			return void(out.append(F("N/A")));
+		format_timer(fill_timer, now, out);
+	}
+
+	template <class TextT>
+	auto display_chem1_timer(Timestamp now, TextT& out) -> void {
+		if (get_state() != TankState::CHEM_1)
+			return void(out.append(F("N/A")));
+		format_timer(chem1_timer, now, out);
 	}
 
-	auto display_chem1_timer(Timestamp now) -> String {
-		if (state != TankState::CHEM_1)
-			return "N/A";
-		return format_timer(chem1_timer, now);
+	template <class TextT>
+	auto display_chem2_timer(Timestamp now, TextT& out) -> void {
+		if (get_state() != TankState::CHEM_2)
+			return void(out.append(F("N/A")));
+		format_timer(chem2_timer, now, out);
 	}
 
-	auto display_chem2_timer(Timestamp now) -> String {
-		if (state != TankState::CHEM_2)
-			return "N/A";
-		return format_timer(chem2_timer, now);
+	// Until the entry action of a new state has run, its timer still holds
+	// the time of its last visit; the entry action starts it over
+	auto snapshot(Timestamp now) -> TankSnapshot {
+		auto* timer = fsm.changed() ? nullptr : active_timer();
+		auto const elapsed = timer ? timer->elapsedSec(now) : 0;
+		return {static_cast<uint8_t>(get_state()),
+				static_cast<uint16_t>(elapsed)};
 	}
 
-	auto restore_state() -> void {
-		auto const saved = state_saver.read();
-		log("Restoring state, raw value = ", saved);
+	// Enters the snapshot's state with its timer already running for as long
+	// as it had been, so an interrupted cycle continues instead of restarting
+	auto resume(TankSnapshot saved, Timestamp now) -> void {
+		log(TOK("Resuming, raw state = "), saved.state, TOK(", elapsed = "),
+			saved.elapsed_s, TOK(" s"));
 
-		auto parsed = static_cast<TankState>(saved);
+		auto parsed = static_cast<TankState>(saved.state);
 		if (parsed >= TankState::LAST) {
 			parsed = TankState::INITIAL;
 		}
-		set_state(parsed);
+		if (!fsm.set(*this, parsed)) {
+			// Someone else has the in-process line, this one starts over.
+			// A refused fill stays queued and starts when the pump is free.
+			in_process.release();
+		}
+		fsm.tick(*this, now);
+		if (auto* timer = active_timer())
+			timer->resume(now, kev::Duration{saved.elapsed_s * 1000l});
+	}
+	auto get_state() const -> TankState { return fsm.current(); }
+
+	// See kev::Arbiter::position()
+	auto fill_position() const -> uint8_t { return fill_line.position(); }
+	auto in_process_position() const -> uint8_t {
+		return in_process.position();
+	}
+
+	static auto fsm_table() -> Fsm::Table const& {
+		using S = TankState;
+		using E = TankEvent;
+		// clang-format off
+		static constexpr auto table PROGMEM = Fsm::Table{
+			{
+				{S::INITIAL, "INITIAL", &TankSM::enter_stopped, &TankSM::exit_initial, nullptr},
+				{S::PRE_FILL, "PRE_FILL", &TankSM::enter_pre_fill, &TankSM::exit_pre_fill, &TankSM::lock_fill},
+				{S::FILLING, "FILLING", &TankSM::enter_filling, &TankSM::exit_filling, &TankSM::lock_fill},
+				{S::WAITING_CHEM_1, "WAITING_CHEM_1", &TankSM::enter_stopped, nullptr, nullptr},
+				{S::CHEM_1, "CHEM_1", &TankSM::enter_chem_1, nullptr, nullptr},
+				{S::WAITING_CHEM_2, "WAITING_CHEM_2", &TankSM::enter_stopped, nullptr, nullptr},
+				{S::CHEM_2, "CHEM_2", &TankSM::enter_chem_2, nullptr, nullptr},
+				{S::WAITING_IN_PROCESS, "WAITING_IN_PROCESS", &TankSM::enter_stopped, &TankSM::exit_waiting_in_process, nullptr},
+				{S::IN_PROCESS, "IN_PROCESS", &TankSM::enter_in_process, &TankSM::exit_in_process, &TankSM::lock_in_process},
+			},
+			{
+				{E::NEXT, "next"},
+				{E::CANCEL, "cancel"},
+				{E::FORCE_NEXT, "force_next_stage"},
+				{E::FORCE_PREV, "force_prev_stage"},
+				{E::FILL_FINISH, "fill_finish"},
+				{E::TIMEOUT, "timeout"},
+				{E::SENSOR_HI, "sensor_hi"},
+				{E::GRANTED, "granted"},
+			},
+			{
+				{S::INITIAL, E::NEXT, S::PRE_FILL},
+				{S::INITIAL, E::GRANTED, S::PRE_FILL},
+				{S::INITIAL, E::FORCE_NEXT, S::WAITING_CHEM_1},
+				{S::INITIAL, E::FORCE_PREV, S::WAITING_IN_PROCESS},
+
+				{S::PRE_FILL, E::CANCEL, S::INITIAL},
+				{S::PRE_FILL, E::TIMEOUT, S::FILLING},
+
+				{S::FILLING, E::CANCEL, S::INITIAL},
+				{S::FILLING, E::FILL_FINISH, S::WAITING_CHEM_1},
+				{S::FILLING, E::TIMEOUT, S::WAITING_CHEM_1},
+				{S::FILLING, E::SENSOR_HI, S::WAITING_CHEM_1},
+
+				{S::WAITING_CHEM_1, E::NEXT, S::CHEM_1},
+				{S::WAITING_CHEM_1, E::FORCE_NEXT, S::WAITING_CHEM_2},
+				{S::WAITING_CHEM_1, E::FORCE_PREV, S::INITIAL},
+
+				{S::CHEM_1, E::CANCEL, S::WAITING_CHEM_1},
+				{S::CHEM_1, E::TIMEOUT, S::WAITING_CHEM_2},
+
+				{S::WAITING_CHEM_2, E::NEXT, S::CHEM_2},
+				{S::WAITING_CHEM_2, E::FORCE_NEXT, S::WAITING_IN_PROCESS},
+				{S::WAITING_CHEM_2, E::FORCE_PREV, S::WAITING_CHEM_1},
+
+				{S::CHEM_2, E::CANCEL, S::WAITING_CHEM_2},
+				{S::CHEM_2, E::TIMEOUT, S::WAITING_CHEM_2},
+
+				{S::WAITING_IN_PROCESS, E::NEXT, S::IN_PROCESS},
+				{S::WAITING_IN_PROCESS, E::GRANTED, S::IN_PROCESS},
+				{S::WAITING_IN_PROCESS, E::FORCE_NEXT, S::INITIAL},
+				{S::WAITING_IN_PROCESS, E::FORCE_PREV, S::WAITING_CHEM_2},
+
+				{S::IN_PROCESS, E::NEXT, S::INITIAL},
+				{S::IN_PROCESS, E::CANCEL, S::WAITING_IN_PROCESS},
+			},
+		};
+		// clang-format on
+		return table;
 	}
-	auto get_state() -> TankState { return state; }
 
    private:
-	auto format_timer(Timer& t, Timestamp now) -> String {
-		return format_seconds(t.elapsedSec(now)) + "/" +
-			   format_seconds(t.totalSec());
+	// Operator events, the ones worth a log line when they do nothing
+	auto event(TankEvent e) -> void {
+		if (fsm.dispatch(*this, e))
+			return;
+		// Queued, lock_fill() or lock_in_process() already said so
+		if (e == TankEvent::NEXT && (waiting(fill_line) || waiting(in_process)))
+			return;
+		log(TOK("Ignoring event "), Fsm::name(e), TOK(" in state "),
+			state_text());
+	}
+	template <class TextT>
+	auto format_timer(Timer& t, Timestamp now, TextT& out) -> void {
+		format_seconds(t.elapsedSec(now), out);
+		out.append('/');
+		format_seconds(t.totalSec(), out);
 	}
 
-	auto format_seconds(long sec) -> String {
+	template <class TextT>
+	auto format_seconds(long sec, TextT& out) -> void {
 		auto min = sec / 60;
 		auto s = sec % 60;
-		return pad2(min) + ":" + pad2(s);
+		out.append_pad2(min).append(':').append_pad2(s);
 	}
 
-	auto pad2(long n) -> String {
-		if (n >= 10 || n < 0)
-			return String{n};
-		return "0" + String{n};
+	auto enter_stopped(Timestamp) -> void { stop_all(); }
+
+	auto enter_pre_fill(Timestamp now) -> void {
+		out_ingress_valve = true;
+		pre_fill_timer.reset(now);
 	}
 
-	auto handle_state_changed(Timestamp now) -> void {
-		switch (state) {
-		case TankState::INITIAL: {
-			stop_all();
-		}; break;
-		case TankState::PRE_FILL: {
-			out_ingress_valve = true;
-			pre_fill_timer.reset(now);
-		}; break;
-		case TankState::FILLING: {
-			out_fill_pump = true;
-			fill_timer.reset(now);
-		}; break;
-		case TankState::CHEM_1: {
-			out_ingress_valve = false;
-			out_fill_pump = false;
-			out_recir_pump = true;
-			chem1_timer.reset(now);
-		}; break;
-		case TankState::CHEM_2: {
-			out_ingress_valve = false;
-			out_fill_pump = false;
-			out_recir_pump = true;
-			chem2_timer.reset(now);
-		}; break;
-		case TankState::WAITING_CHEM_1:
-		case TankState::WAITING_CHEM_2:
-		case TankState::WAITING_IN_PROCESS: stop_all(); break;
-		case TankState::IN_PROCESS: {
-			out_process_valve = true;
-		}; break;
-		case TankState::LAST: log("Error, state LAST should not be set");
-		}
+	// The valve is open already after PRE_FILL, but not when a snapshot
+	// resumes straight into FILLING
+	auto enter_filling(Timestamp now) -> void {
+		out_ingress_valve = true;
+		out_fill_pump = true;
+		fill_timer.reset(now);
+	}
 
-		// On next tick do not handle as a change
-		prev_state = state;
+	auto enter_chem_1(Timestamp now) -> void {
+		out_ingress_valve = false;
+		out_fill_pump = false;
+		out_recir_pump = true;
+		chem1_timer.reset(now);
 	}
 
-	auto state_transitions(Timestamp now) -> void {
-		switch (state) {
-		case TankState::PRE_FILL: {
-			if (pre_fill_timer.isDone(now)) {
-				set_state(TankState::FILLING);
-			}
-		}; break;
-		case TankState::FILLING: {
-			if (fill_timer.isDone(now)) {
-				log("Alerta: Finalizando llenado por tiempo de seguridad");
-				set_state(TankState::WAITING_CHEM_1);
-			}
-			if (in_sensor_hi_edge.risingEdge()) {
-				set_state(TankState::WAITING_CHEM_1);
-			}
-		}; break;
-		case TankState::CHEM_1: {
-			if (chem1_timer.isDone(now)) {
-				set_state(TankState::WAITING_CHEM_2);
-			}
-		}; break;
-		case TankState::CHEM_2: {
-			if (chem2_timer.isDone(now)) {
-				set_state(TankState::WAITING_CHEM_2);
-			}
-		}; break;
-		case TankState::INITIAL:
-		case TankState::WAITING_CHEM_1:
-		case TankState::WAITING_CHEM_2:
-		case TankState::WAITING_IN_PROCESS:
-		case TankState::IN_PROCESS: break;
-		case TankState::LAST: log("Error, state LAST should not be set"); break;
-		}
+	auto enter_chem_2(Timestamp now) -> void {
+		out_ingress_valve = false;
+		out_fill_pump = false;
+		out_recir_pump = true;
+		chem2_timer.reset(now);
 	}
 
-	auto changed() -> bool { return state != prev_state; }
+	auto enter_in_process(Timestamp) -> void { out_process_valve = true; }
 
-	auto stop_all() -> void {
-		out_fill_pump = false;
-		out_recir_pump = false;
-		out_ingress_valve = false;
+	// Tanks fill one at a time with the whole pump flow instead of sharing
+	// it, the next in line starts as soon as the current fill ends. Queues
+	// the tank in INITIAL when the pump is taken.
+	auto lock_fill() -> bool {
+		if (fill_line.request())
+			return true;
+		log(TOK("Fill pump busy, waiting at position "), fill_line.position());
+		return false;
 	}
 
-	auto set_state(TankState requested_state) -> void {
-		if (requested_state == TankState::IN_PROCESS &&
-			in_process_mutex.try_lock() != MutexError::SUCCESS) {
-			log("Not setting in process because the in_process_mutex is "
-				"locked");
-			return;
-		}
+	// Whoever leaves INITIAL some other way gives up its place in line
+	auto exit_initial(TankState to) -> void {
+		if (to != TankState::PRE_FILL)
+			fill_line.release();
+	}
 
-		prev_state = state;
-		state = requested_state;
+	auto exit_pre_fill(TankState to) -> void {
+		if (to != TankState::FILLING)
+			fill_line.release();
+	}
 
-		if (prev_state == TankState::IN_PROCESS &&
-			state != TankState::IN_PROCESS) {
-			in_process_mutex.unlock();
-		}
+	auto exit_filling(TankState) -> void { fill_line.release(); }
 
-		if (state_should_be_persisted()) {
-			persist_state();
-		}
+	// Queues the tank when another one is in process
+	auto lock_in_process() -> bool {
+		if (in_process.request())
+			return true;
+		log(TOK("In-process line busy, waiting at position "),
+			in_process.position());
+		return false;
+	}
+
+	auto exit_waiting_in_process(TankState to) -> void {
+		if (to != TankState::IN_PROCESS)
+			in_process.release();
+	}
+
+	// The next tank in line gets it right away, so this one stops feeding
+	// the process first
+	auto exit_in_process(TankState) -> void {
+		out_process_valve = false;
+		in_process.release();
+	}
+
+	static auto in_line(kev::Arbiter::Handle const& line) -> bool {
+		return line.position() != kev::Arbiter::NONE;
 	}
 
-	auto state_should_be_persisted() -> bool {
-		return state == TankState::INITIAL ||
-			   state == TankState::WAITING_CHEM_1 ||
-			   state == TankState::WAITING_CHEM_2 ||
-			   state == TankState::WAITING_IN_PROCESS;
+	// In line behind another tank
+	static auto waiting(kev::Arbiter::Handle const& line) -> bool {
+		return in_line(line) && !line.holds();
 	}
 
-	auto persist_state() -> void {
-		state_saver.save(static_cast<uint8_t>(state));
+	// Its turn came while it waited, tick() moves it on
+	auto granted() const -> bool {
+		switch (get_state()) {
+		case TankState::INITIAL: return fill_line.holds();
+		case TankState::WAITING_IN_PROCESS: return in_process.holds();
+		default: return false;
+		}
 	}
 
-	auto state_text() -> char const* {
-		switch (state) {
-		case TankState::INITIAL: return "INITIAL";
-		case TankState::PRE_FILL: return "PRE_FILL";
-		case TankState::FILLING: return "FILLING";
-		case TankState::WAITING_CHEM_1: return "WAITING_CHEM_1";
-		case TankState::CHEM_1: return "CHEM_1";
-		case TankState::WAITING_CHEM_2: return "WAITING_CHEM_2";
-		case TankState::CHEM_2: return "CHEM_2";
-		case TankState::WAITING_IN_PROCESS: return "WAITING_IN_PROCESS";
-		case TankState::IN_PROCESS: return "IN_PROCESS";
-		case TankState::LAST: return "LAST (ERROR)";
+	auto active_timer() -> Timer* {
+		switch (get_state()) {
+		case TankState::PRE_FILL: return &pre_fill_timer;
+		case TankState::FILLING: return &fill_timer;
+		case TankState::CHEM_1: return &chem1_timer;
+		case TankState::CHEM_2: return &chem2_timer;
+		default: return nullptr;
 		}
-		return "INVALID";
 	}
 
+	auto stop_all() -> void {
+		out_fill_pump = false;
+		out_recir_pump = false;
+		out_ingress_valve = false;
+	}
+
+	auto state_text() -> kev::LogText { return Fsm::name(get_state()); }
+
 	Log<> log;
 
-	OutFillPump& out_fill_pump;
-	OutRecirPump& out_recir_pump;
-	OutIngressValve& out_ingress_valve;
-	OutProcessValve& out_process_valve;
-	EdgeDebounced<InSensorHi> in_sensor_hi_edge;
-	EdgeDebounced<InAqSensorLo> in_aq_sensor_lo_edge;
-	StateSaver& state_saver;
-	Mutex& in_process_mutex;
-
-	TankState state = {};
-	TankState prev_state = {};
+	kev::OutputRef out_fill_pump;
+	kev::OutputRef out_recir_pump;
+	kev::OutputRef out_ingress_valve;
+	kev::OutputRef out_process_valve;
+	kev::DebouncedInput in_sensor_hi_edge;
+	kev::DebouncedInput in_aq_sensor_lo_edge;
+	kev::Arbiter::Handle fill_line;
+	kev::Arbiter::Handle in_process;
+
+	Fsm fsm;
 
 	Timer pre_fill_timer{TIME_PRE_FILL};
 	Timer fill_timer{TIME_FILL_FAILSAFE};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include "Flash.h"
+#include "Time.h"
+#include "Timer.h"
+
+namespace kev {
+
+// One tank of the plant description, see main.cpp. Kept in PROGMEM.
+struct TankInfo {
+	// As the operators know it, "Tanque 3"
+	char name[12];
+	uint16_t capacity_l;
+	// Ends its console commands, 'a' in "next a"
+	char console_id;
+	// Nextion page the home screen opens to pick this tank
+	uint8_t select_page;
+};
+
+// References to tank state machines of different types, expanded at compile
+// time so no call goes through a pointer
+template <class... Ts>
+struct TankRefs {
+	template <class Fn>
+	auto for_each(Fn&, uint8_t) -> void {}
+};
+
+template <class T, class... Ts>
+struct TankRefs<T, Ts...> {
+	TankRefs(T& first, Ts&... rest) : first{first}, rest{rest...} {}
+
+	template <class Fn>
+	auto for_each(Fn& fn, uint8_t i) -> void {
+		fn(i, first);
+		rest.for_each(fn, i + 1);
+	}
+
+	template <class Fn>
+	auto visit(uint8_t i, Fn& fn) -> decltype(auto) {
+		if constexpr (sizeof...(Ts) == 0) {
+			return fn(first);
+		} else {
+			if (i == 0)
+				return fn(first);
+			return rest.visit(i - 1, fn);
+		}
+	}
+
+	T& first;
+	TankRefs<Ts...> rest;
+};
+
+// Every tank of the plant with its description, in the same order. Code
+// that deals with "the tanks" goes through this instead of naming them, so
+// adding one only touches main.cpp.
+template <class... TankSMs>
+struct Tanks {
+	static constexpr uint8_t SIZE = sizeof...(TankSMs);
+	static_assert(SIZE > 0, "A plant needs at least one tank");
+
+	Tanks(TankInfo const (&infos)[SIZE], TankSMs&... tanks)
+		: infos{infos}, refs{tanks...} {}
+
+	[[nodiscard]] auto info(uint8_t i) const -> TankInfo {
+		auto info = TankInfo{};
+		memcpy_P(&info, &infos[i], sizeof(info));
+		return info;
+	}
+
+	// fn(index, tank) for each tank, in order
+	template <class Fn>
+	auto for_each(Fn fn) -> void {
+		refs.for_each(fn, 0);
+	}
+
+	// fn(tank) for tank `i`, which must be below SIZE
+	template <class Fn>
+	auto visit(uint8_t i, Fn fn) -> decltype(auto) {
+		return refs.visit(i, fn);
+	}
+
+	// SIZE when no tank has that id
+	[[nodiscard]] auto find(char console_id) const -> uint8_t {
+		uint8_t i = 0;
+		while (i < SIZE && pgm_read_byte(&infos[i].console_id) != console_id)
+			++i;
+		return i;
+	}
+
+	auto next_deadline(Timestamp now) -> Timestamp {
+		auto deadline = now + NO_DEADLINE;
+		for_each([&](uint8_t, auto& tank) {
+			deadline = earliest(now, deadline, tank.next_deadline(now));
+		});
+		return deadline;
+	}
+
+   private:
+	TankInfo const* infos;
+	TankRefs<TankSMs...> refs;
+};
+
+}  // namespace kev
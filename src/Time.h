@@ -1,5 +1,7 @@
 #pragma once
 
+#include <limits.h>
+
 namespace kev {
 
 class Duration {
@@ -44,16 +46,50 @@ inline constexpr auto operator+(Duration const& lhs, Duration const& rhs)
 	return Duration{lhs.unsafeGetValue() + rhs.unsafeGetValue()};
 }
 
+// Calling them from a constant expression is what makes the build fail
+inline auto duration_literal_not_decimal() -> void {}
+inline auto duration_literal_too_long() -> void {}
+
+// Milliseconds in a _ms/_s/_min literal, `Scale` of them per unit, from the
+// literal's characters
+template <long Scale, char... Chars>
+constexpr auto duration_literal_ms() -> long {
+	char const chars[] = {Chars...};
+	long units = 0;
+	for (auto const c : chars) {
+		if (c == '\'')
+			continue;
+		if (c < '0' || c > '9' || (units == 0 && c == '0' && sizeof(chars) > 1))
+			duration_literal_not_decimal();
+		auto const digit = static_cast<long>(c - '0');
+		if (units > (LONG_MAX - digit) / 10)
+			duration_literal_too_long();
+		units = units * 10 + digit;
+	}
+	if (units > LONG_MAX / Scale)
+		duration_literal_too_long();
+	return units * Scale;
+}
+
+// Worked out while compiling, so a literal that does not fit a Duration
+// (24.8 days where long has 32 bits) is an error instead of a wrapped value
+template <long Scale, char... Chars>
+constexpr auto duration_literal =
+	Duration{duration_literal_ms<Scale, Chars...>()};
+
 namespace literals {
 
-inline constexpr auto operator""_ms(unsigned long long t) -> Duration {
-	return Duration{static_cast<long>(t)};
+template <char... Chars>
+constexpr auto operator""_ms() -> Duration {
+	return duration_literal<1, Chars...>;
 }
-inline constexpr auto operator""_s(unsigned long long t) -> Duration {
-	return Duration{static_cast<long>(t * 1000ul)};
+template <char... Chars>
+constexpr auto operator""_s() -> Duration {
+	return duration_literal<1000, Chars...>;
 }
-inline constexpr auto operator""_min(unsigned long long t) -> Duration {
-	return Duration{static_cast<long>(t * 60ul * 1000ul)};
+template <char... Chars>
+constexpr auto operator""_min() -> Duration {
+	return duration_literal<60000, Chars...>;
 }
 
 }  // namespace literals
@@ -64,6 +100,9 @@ class Timestamp {
    public:
 	constexpr Timestamp() = default;
 	constexpr Timestamp(unsigned long value) : value{value} {}
+	[[nodiscard]] constexpr auto unsafeGetValue() const -> unsigned long {
+		return value;
+	}
 	friend constexpr auto operator-(Timestamp const&, Timestamp const&)
 		-> Duration;
 	friend constexpr auto operator+(Timestamp const&, Duration const&)
@@ -82,4 +121,16 @@ constexpr auto operator+(Timestamp const& stamp, Duration const& dur)
 	return {stamp.value + static_cast<unsigned long>(dur.unsafeGetValue())};
 }
 
+constexpr auto operator-(Timestamp const& stamp, Duration const& dur)
+	-> Timestamp {
+	return stamp + Duration{-dur.unsafeGetValue()};
+}
+
+// Timestamps wrap with millis(), their differences stay right across it as
+// long as they fit a Duration
+static_assert(Timestamp{1} - Timestamp{ULONG_MAX} == Duration{2},
+			  "Difference across the wrap");
+static_assert((Timestamp{ULONG_MAX} + Duration{2}).unsafeGetValue() == 1,
+			  "Sum across the wrap");
+
 }  // namespace kev
@@ -3,12 +3,36 @@
 
 namespace kev {
 
+// What a next_deadline() returns when nothing is pending, so whoever sleeps
+// on it still wakes up now and then
+constexpr auto NO_DEADLINE = Duration{60000};
+
+// Compared relative to now, which keeps it right across millis() wrapping.
+// Deadlines already past count as now.
+constexpr auto earliest(Timestamp now, Timestamp a, Timestamp b) -> Timestamp {
+	return (a - now) < (b - now) ? a : b;
+}
+
 struct Timer {
-	Timer(Duration setting) : setting{setting} {}
+	constexpr Timer(Duration setting) : setting{setting} {}
+
+	constexpr auto reset(Timestamp now) -> void { last = now; }
+
+	// As if reset() had been called `elapsed` ago
+	constexpr auto resume(Timestamp now, Duration elapsed) -> void {
+		last = now - elapsed;
+	}
 
-	auto reset(Timestamp now) -> void { last = now; }
+	// Wrap-safe while it is asked at least once within 24.8 days of running
+	// out, the span of a Duration
+	constexpr auto isDone(Timestamp now) -> bool {
+		return (now - last) > setting;
+	}
 
-	auto isDone(Timestamp now) -> bool { return (now - last) > setting; }
+	// First timestamp for which isDone() is true
+	constexpr auto deadline() const -> Timestamp {
+		return last + setting + Duration{1};
+	}
 
 	auto elapsedSec(Timestamp now) -> long {
 		return (now - last).unsafeGetValue() / 1000;
@@ -20,4 +44,14 @@ struct Timer {
 	const Duration setting;
 };
 
+// A timer running while millis() wraps still runs out on time
+static_assert(
+	[] {
+		auto t = Timer{Duration{10}};
+		t.reset(Timestamp{ULONG_MAX - 4});
+		return !t.isDone(Timestamp{ULONG_MAX}) && !t.isDone(Timestamp{5}) &&
+			   t.isDone(Timestamp{6}) && t.deadline().unsafeGetValue() == 6;
+	}(),
+	"Timer across the wrap of millis()");
+
 }  // namespace kev
@@ -0,0 +1,49 @@
+#pragma once
+// Shared by the firmware and tools/logdecode, keep it free of Arduino headers
+
+#include <stdint.h>
+#include "Hash.h"
+
+namespace kev {
+
+// Compile time id standing in for a string literal in tokenized logs
+struct Token {
+	uint16_t id;
+};
+
+constexpr auto token_id(char const* s) -> uint16_t {
+	auto const h = fnv1a(s);
+	return static_cast<uint16_t>((h >> 16) ^ (h & 0xFFFFu));
+}
+
+// Forces token_id to run at compile time so the literal is not emitted
+template <uint16_t id>
+struct TokenId {
+	static constexpr uint16_t value = id;
+};
+
+// Tokenized log frame:
+//   FRAME_START name:u16le (tag payload)* END
+// u16 values are little endian, varints are LEB128 and signed ones zigzag.
+// Text outside frames is plain ASCII, so 0xFE never starts anything else.
+enum class LogTag : uint8_t {
+	TOKEN = 0x01,     // u16le
+	INT = 0x02,       // zigzag varint
+	UINT = 0x03,      // varint
+	STRING = 0x04,    // u8 length, bytes
+	CHAR = 0x05,      // byte
+	UINT_HEX = 0x06,  // varint, shown in base 16
+	END = 0x0A,
+	FRAME_START = 0xFE,
+};
+
+}  // namespace kev
+
+// Otherwise the literal stays in program memory, see kev::FlashString. The
+// lambda lets TOK() initialize members and globals too, where F() cannot be
+// used.
+#ifdef KEV_LOG_TOKENIZED
+#define TOK(s) (::kev::Token{::kev::TokenId<::kev::token_id(s)>::value})
+#else
+#define TOK(s) ([] { return F(s); }())
+#endif
@@ -3,46 +3,83 @@
 #include "HardwareSerial.h"
 #include "Log.h"
 #include "TankSM.h"
+#include "Tanks.h"
 
-template <class TankASM, class TankBSM, class AqueductSM>
+using kev::LogOverflow;
+
+template <class TanksT, class AqueductSM, class StatsT>
 struct UiSerial {
-	UiSerial(TankASM& tank_a_sm, TankBSM& tank_b_sm, AqueductSM& aqueduct_sm)
-		: tank_a_sm{tank_a_sm},
-		  tank_b_sm{tank_b_sm},
-		  aqueduct_sm{aqueduct_sm} {}
+	UiSerial(TanksT& tanks, AqueductSM& aqueduct_sm, StatsT& stats)
+		: tanks{tanks}, aqueduct_sm{aqueduct_sm}, stats{stats} {}
 
 	auto tick() {
 		if (Serial.available()) {
 			auto cmd = Serial.readStringUntil('\n');
-			log("cmd = ", cmd);
+			log(TOK("cmd = "), cmd);
 
 			process(cmd);
 		}
+
+		// A line at a time, so the report never floods the log buffer
+		if (report_line < StatsT::report_lines() &&
+			kev::log_buffer.pending() < 512) {
+			stats.report(log, report_line++);
+		}
+	}
+
+	auto next_deadline(Timestamp now) -> Timestamp {
+		if (Serial.available() || report_line < StatsT::report_lines())
+			return now;
+		return now + kev::NO_DEADLINE;
 	}
 
 	auto process(String const& cmd) -> void {
+		// Tank commands end in the tank's id, "next a"
+		auto const n = cmd.length();
+		if (n > 2 && cmd[n - 2] == ' ') {
+			if (auto const i = tanks.find(cmd[n - 1]); i < TanksT::SIZE)
+				tanks.visit(i, [&](auto& sm) { tank_command(cmd, sm); });
+		}
+
 		// clang-format off
-		if (cmd == "next a") tank_a_sm.event_next();
-		if (cmd == "next b") tank_b_sm.event_next();
-		if (cmd == "cancel a") tank_a_sm.event_cancel();
-		if (cmd == "cancel b") tank_b_sm.event_cancel();
-		if (cmd == "fill finish a") tank_a_sm.event_fill_finish();
-		if (cmd == "fill finish b") tank_b_sm.event_fill_finish();
-		if (cmd == "fnext a") tank_a_sm.event_force_next_stage();
-		if (cmd == "fnext b") tank_b_sm.event_force_next_stage();
-		if (cmd == "fprev a") tank_a_sm.event_force_prev_stage();
-		if (cmd == "fprev b") tank_b_sm.event_force_prev_stage();
-		if (cmd == "aq valve on") aqueduct_sm.event_valve_on();
-		if (cmd == "aq valve off") aqueduct_sm.event_valve_off();
-		if (cmd == "aq pump on") aqueduct_sm.event_pump_on();
-		if (cmd == "aq pump off") aqueduct_sm.event_pump_off();
-		if (cmd == "aq sensor hi") aqueduct_sm.event_sensor_hi();
+		if (is(cmd, F("aq valve on"))) aqueduct_sm.event_valve_on();
+		if (is(cmd, F("aq valve off"))) aqueduct_sm.event_valve_off();
+		if (is(cmd, F("aq pump on"))) aqueduct_sm.event_pump_on();
+		if (is(cmd, F("aq pump off"))) aqueduct_sm.event_pump_off();
+		if (is(cmd, F("aq sensor hi"))) aqueduct_sm.event_sensor_hi();
+		if (is(cmd, F("log drop oldest"))) kev::log_buffer.set_policy(LogOverflow::DROP_OLDEST);
+		if (is(cmd, F("log drop newest"))) kev::log_buffer.set_policy(LogOverflow::DROP_NEWEST);
+		if (is(cmd, F("stats"))) report_line = 0;
+		if (is(cmd, F("stats reset"))) stats.reset();
 		// clang-format on
 	}
 
    private:
-	Log<> log = {"serial"};
-	TankASM& tank_a_sm;
-	TankBSM& tank_b_sm;
+	template <class TankSM>
+	static auto tank_command(String const& cmd, TankSM& sm) -> void {
+		// clang-format off
+		if (is_verb(cmd, F("next"))) sm.event_next();
+		if (is_verb(cmd, F("cancel"))) sm.event_cancel();
+		if (is_verb(cmd, F("fill finish"))) sm.event_fill_finish();
+		if (is_verb(cmd, F("fnext"))) sm.event_force_next_stage();
+		if (is_verb(cmd, F("fprev"))) sm.event_force_prev_stage();
+		// clang-format on
+	}
+
+	static auto is(String const& cmd, kev::FlashString text) -> bool {
+		return strcmp_P(cmd.c_str(), kev::flash_chars(text)) == 0;
+	}
+
+	// `verb` followed by a space and a tank id
+	static auto is_verb(String const& cmd, kev::FlashString verb) -> bool {
+		auto const len = kev::flash_strlen(verb);
+		return cmd.length() == len + 2 &&
+			   strncmp_P(cmd.c_str(), kev::flash_chars(verb), len) == 0;
+	}
+
+	Log<> log = {TOK("serial")};
+	TanksT& tanks;
 	AqueductSM& aqueduct_sm;
+	StatsT& stats;
+	uint8_t report_line = StatsT::report_lines();
 };
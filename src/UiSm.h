@@ -2,171 +2,396 @@
 
 #include "AqueductSM.h"
 #include "Arduino.h"
+#include "Clock.h"
+#include "FixedString.h"
+#include "Fsm.h"
 #include "HardwareSerial.h"
 #include "Log.h"
+#include "NexCommands.h"
 #include "NexHardware.h"
+#include "NexShadow.h"
 #include "NextionUtils.h"
 #include "TankSM.h"
+#include "Tanks.h"
 #include "Timer.h"
 
 using namespace kev::literals;
 using kev::Timer;
 using kev::Timestamp;
 
-enum struct UiState {
-	// Underlying numbers double as page ids
+// Long enough for the longest status line on the Nextion
+using UiText = kev::FixedString<48>;
+
+// Page ids of the Nextion project. Besides these, every tank has a page
+// that only selects it, see kev::TankInfo::select_page.
+enum struct UiPage : uint8_t {
 	HOME = 0,
-	WAITING_TANK_A = 1,
-	WAITING_TANK_B = 2,
 	STATUS = 3,
 	ADVANCED = 4,
 	AQUEDUCT = 5,
+};
+
+enum struct UiState : uint8_t {
+	HOME,
+	SELECTING_TANK,
+	STATUS,
+	ADVANCED,
+	AQUEDUCT,
+	// At 9600 baud until the display has taken the switch to 115200
+	CONNECTING,
+	// At 115200 while the display changes over
+	SETTLING,
+
+	LAST,
+};
+
+enum struct UiEvent : uint8_t {
+	// The display changed to that page
+	SHOW_HOME,
+	SHOW_TANK,
+	SHOW_STATUS,
+	SHOW_ADVANCED,
+	SHOW_AQUEDUCT,
+	TANK_SELECTED,
+	// A connect timer ran out
+	BAUD_SENT,
+	SETTLED,
+	// The display did not answer the setup
+	RECONNECT,
 
 	LAST,
 };
 
-enum struct UiTank {
-	A,
-	B,
+// What each outstanding Nextion command was sent for
+enum struct UiCommand : uint8_t {
+	SETUP,
+	PAGE,
+	SET,
+	GET_VALVE,
+	GET_PUMP,
 };
 
-template <class TankASM,
-		  class TankBSM,
-		  class AqueductSM,
-		  class SerialT = HardwareSerial>
+template <class TanksT, class AqueductSM, class SerialT = HardwareSerial>
 struct UiSm {
-	UiSm(SerialT& serial,
-		 TankASM& tank_a_sm,
-		 TankBSM& tank_b_sm,
-		 AqueductSM& aqueduct_sm)
+	using Fsm = kev::Fsm<UiSm, UiState, UiEvent>;
+
+	UiSm(SerialT& serial, TanksT& tanks, AqueductSM& aqueduct_sm)
 		: serial{serial},
-		  tank_a_sm{tank_a_sm},
-		  tank_b_sm{tank_b_sm},
-		  aqueduct_sm{aqueduct_sm} {}
+		  tanks{tanks},
+		  aqueduct_sm{aqueduct_sm},
+		  commands{serial} {}
 	auto init() -> void {
-		serial.begin(9600);
-		serial.print("baud=115200\xFF\xFF\xFF");
-		recvRetCommandFinished(serial);
-		serial.begin(115200);
-		serial.print("bkcmd=1\xFF\xFF\xFF");
-		recvRetCommandFinished(serial);
-		serial.print("page 0\xFF\xFF\xFF");
-		recvRetCommandFinished(serial);
-		log("Initialized");
+		fsm.set(*this, UiState::CONNECTING);
+		log(TOK("Initialized"));
 	}
 
 	auto tick(Timestamp now) -> void {
-		if (serial.available()) {
-			process_ui_command();
-		}
+		process_ui_input(now);
+		process_timeouts(now);
+		fsm.tick(*this, now);
+
+		if (fsm.current() == UiState::CONNECTING && baud_sent.isDone(now))
+			fsm.dispatch(*this, UiEvent::BAUD_SENT);
+		if (fsm.current() == UiState::SETTLING && baud_settled.isDone(now))
+			fsm.dispatch(*this, UiEvent::SETTLED);
+	}
 
-		switch (state) {
-		case UiState::WAITING_TANK_A: {
-			tank = UiTank::A;
-			page_status();
-			set_state(UiState::STATUS);
-		}; break;
-		case UiState::WAITING_TANK_B: {
-			tank = UiTank::B;
-			page_status();
-			set_state(UiState::STATUS);
-		}; break;
-		case UiState::STATUS: {
-			if (status_update_timer.isDone(now)) {
-				status_update_timer.reset(now);
-				update_status(now);
-			}
-		}; break;
-		case UiState::AQUEDUCT: {
-			if (aq_update_timer.isDone(now)) {
-				aq_update_timer.reset(now);
-				update_aqueduct();
-			}
-		}; break;
+	// Periodic redraw of the page on screen, only values that changed are
+	// actually sent
+	auto refresh(Timestamp now) -> void {
+		switch (fsm.current()) {
+		case UiState::STATUS: update_status(now); break;
+		case UiState::AQUEDUCT: update_aqueduct(now); break;
 		default: break;  // noop
 		}
 	}
 
+	// Input from the display wakes the loop by itself, see kev::idle_until()
+	auto next_deadline(Timestamp now) -> Timestamp {
+		if (fsm.changed())
+			return now;
+		auto const reply = commands.next_deadline(now);
+		switch (fsm.current()) {
+		case UiState::CONNECTING:
+			return kev::earliest(now, reply, baud_sent.deadline());
+		case UiState::SETTLING:
+			return kev::earliest(now, reply, baud_settled.deadline());
+		default: return reply;
+		}
+	}
+
 	auto log_debug() -> void {
-		log("UI State = ", state_text(), ", Current Tank = ", tank_text());
+		log(TOK("UI State = "), state_text(), TOK(", Current Tank = "),
+			tanks.info(tank).name);
+	}
+
+	static auto fsm_table() -> typename Fsm::Table const& {
+		using S = UiState;
+		using E = UiEvent;
+		// clang-format off
+		static constexpr auto table PROGMEM = typename Fsm::Table{
+			{
+				{S::HOME, "HOME", nullptr, nullptr, nullptr},
+				{S::SELECTING_TANK, "SELECTING_TANK", &UiSm::enter_selecting_tank, nullptr, nullptr},
+				{S::STATUS, "STATUS", nullptr, nullptr, nullptr},
+				{S::ADVANCED, "ADVANCED", nullptr, nullptr, nullptr},
+				{S::AQUEDUCT, "AQUEDUCT", nullptr, nullptr, nullptr},
+				{S::CONNECTING, "CONNECTING", &UiSm::enter_connecting, nullptr, nullptr},
+				{S::SETTLING, "SETTLING", &UiSm::enter_settling, &UiSm::exit_settling, nullptr},
+			},
+			{
+				{E::SHOW_HOME, "show_home"},
+				{E::SHOW_TANK, "show_tank"},
+				{E::SHOW_STATUS, "show_status"},
+				{E::SHOW_ADVANCED, "show_advanced"},
+				{E::SHOW_AQUEDUCT, "show_aqueduct"},
+				{E::TANK_SELECTED, "tank_selected"},
+				{E::BAUD_SENT, "baud_sent"},
+				{E::SETTLED, "settled"},
+				{E::RECONNECT, "reconnect"},
+			},
+			{
+				// The display can go to any page from anywhere
+				{S::LAST, E::SHOW_HOME, S::HOME},
+				{S::LAST, E::SHOW_TANK, S::SELECTING_TANK},
+				{S::LAST, E::SHOW_STATUS, S::STATUS},
+				{S::LAST, E::SHOW_ADVANCED, S::ADVANCED},
+				{S::LAST, E::SHOW_AQUEDUCT, S::AQUEDUCT},
+
+				{S::SELECTING_TANK, E::TANK_SELECTED, S::STATUS},
+
+				{S::LAST, E::RECONNECT, S::CONNECTING},
+				{S::CONNECTING, E::BAUD_SENT, S::SETTLING},
+				{S::SETTLING, E::SETTLED, S::HOME},
+			},
+		};
+		// clang-format on
+		return table;
 	}
 
    private:
-	auto page_status() -> void {
-		serial.print("page ");
-		serial.print(static_cast<int>(UiState::STATUS));
-		serial.print("\xFF\xFF\xFF");
-		recvRetCommandFinished(serial);
+	auto connecting() const -> bool {
+		return fsm.current() == UiState::CONNECTING ||
+			   fsm.current() == UiState::SETTLING;
+	}
+
+	// `tank` was set along with SHOW_TANK, see event_page_change()
+	auto enter_selecting_tank(Timestamp now) -> void {
+		page_status(now);
+		fsm.dispatch(*this, UiEvent::TANK_SELECTED);
+	}
+
+	auto page_status(Timestamp now) -> void {
+		shadow.clear();
+		commands.send(now, NexReply::ACK, UiCommand::PAGE, F("page "),
+					  static_cast<int>(UiPage::STATUS));
 	}
 
-	auto update_aqueduct() -> void {
-		log("Updating aqueduct screen");
-		set_text("t5_1", aq_status_display());
-		set_button_val("bt0", aqueduct_sm.get_valve());
-		set_button_val("bt1", aqueduct_sm.get_pump());
+	auto update_aqueduct(Timestamp now) -> void {
+		log(TOK("Updating aqueduct screen"));
+		set_text(now, F("t5_1"), aq_status_display());
+		set_button_val(now, F("bt0"), aqueduct_sm.get_valve());
+		set_button_val(now, F("bt1"), aqueduct_sm.get_pump());
 	}
 
-	auto aq_status_display() -> char const* {
+	auto aq_status_display() -> kev::FlashString {
 		switch (aqueduct_sm.get_state()) {
-		case AqState::STOPPED: return "Detenido";
-		case AqState::FILLING: return "Llenando";
-		case AqState::FILLING_PUMP: return "Llenando con Bomba";
+		case AqState::STOPPED: return F("Detenido");
+		case AqState::FILLING: return F("Llenando");
+		case AqState::FILLING_PUMP: return F("Llenando con Bomba");
+		case AqState::LAST: break;
 		}
-		return "Error de programa, informar";
+		return F("Error de programa, informar");
 	}
 
 	auto update_status(Timestamp now) -> void {
-		log("Updating status screen");
-		set_text("t1", tank_display());
-		set_text("t3", state_display());
-		set_text("t4", additional_display(now));
-		set_text("b0", confirm_display());
-	}
-
-	template <class StringT>
-	auto set_text(char const* id, StringT text) -> void {
-		serial.print(id);
-		serial.print(".txt=\"");
-		serial.print(text);
-		serial.print("\"\xFF\xFF\xFF");
-	}
-
-	auto process_ui_command() -> void {
-		auto const raw = receiveRaw(serial);
-		if (!raw.endsWith("\xFF\xFF\xFF")) {
-			log("Invalid command");
-			log_raw(raw);
+		log(TOK("Updating status screen"));
+		set_text(now, F("t1"), tank_display().c_str());
+		set_text(now, F("t3"), state_display());
+		set_text(now, F("t4"), additional_display(now).c_str());
+		set_text(now, F("b0"), confirm_display());
+	}
+
+	auto set_text(Timestamp now, kev::FlashString id, kev::FlashString text)
+		-> void {
+		set_text(now, id, text, kev::flash_fnv1a(text));
+	}
+
+	auto set_text(Timestamp now, kev::FlashString id, char const* text)
+		-> void {
+		set_text(now, id, text, kev::fnv1a(text));
+	}
+
+	template <class TextT>
+	auto set_text(Timestamp now, kev::FlashString id, TextT text, uint32_t hash)
+		-> void {
+		if (!shadow.changed(id, hash))
 			return;
+		if (commands.send(now, NexReply::ACK, UiCommand::SET, id,
+						  F(".txt=\""), text, F("\""))) {
+			shadow.store(id, hash);
 		}
+	}
 
-		if (raw[0] == 0x66) {
-			auto const page = static_cast<uint8_t>(raw[1]);
-			log("Current page = ", page);
-			event_page_change(page);
+	// Only consumes what is already buffered, a partial frame stays in the
+	// parser until the rest arrives on a later tick
+	auto process_ui_input(Timestamp now) -> void {
+		// Sent at the other baud rate or from before the setup, none of it
+		// is a reply to anything
+		if (connecting()) {
+			while (serial.available())
+				serial.read();
 			return;
 		}
+		while (serial.available()) {
+			switch (parser.feed(static_cast<uint8_t>(serial.read()))) {
+			case NexParse::PENDING: break;
+			case NexParse::FRAME: {
+				process_ui_command(parser.frame(), now);
+			}; break;
+			case NexParse::ERROR: {
+				log(TOK("Invalid command"));
+				log_raw(parser.frame());
+			}; break;
+			}
+		}
+	}
 
-		if (raw[0] == 0x65) {
-			auto const page = static_cast<uint8_t>(raw[1]);
-			auto const id = static_cast<uint8_t>(raw[2]);
-			log("Received press event, page = ", page, ", id = ", id);
-			handle_button_press(page, id);
+	auto process_ui_command(NexFrame frame, Timestamp now) -> void {
+		auto result = NexResult<UiCommand>{};
+		if (commands.match(frame, result)) {
+			if (commands.lost() != lost_replies) {
+				lost_replies = commands.lost();
+				shadow.clear();
+			}
+			handle_command_result(result);
 			return;
 		}
 
-		log_raw(raw);
+		switch (frame.head()) {
+		case NEX_RET_CURRENT_PAGE_ID_HEAD: {
+			auto const page = frame[1];
+			log(TOK("Current page = "), page);
+			event_page_change(page);
+		}; return;
+		case NEX_RET_EVENT_TOUCH_HEAD: {
+			auto const page = frame[1];
+			auto const id = frame[2];
+			log(TOK("Received press event, page = "), page, TOK(", id = "), id);
+			handle_button_press(page, id, now);
+		}; return;
+		default: break;
+		}
+
+		log_raw(frame);
+	}
+
+	auto process_timeouts(Timestamp now) -> void {
+		auto result = NexResult<UiCommand>{};
+		while (commands.expire(now, result)) {
+			handle_command_result(result);
+		}
+	}
+
+	// The display is switched to 115200 baud and back to page 0 without
+	// holding up the loop: the command goes out at 9600 in CONNECTING, and
+	// SETTLING gives the display time to change over, as it drops whatever
+	// arrives meanwhile.
+	auto enter_connecting(Timestamp now) -> void {
+		serial.begin(9600);
+		serial.print(F("baud=115200\xFF\xFF\xFF"));
+		baud_sent.reset(now);
+	}
+
+	auto enter_settling(Timestamp now) -> void {
+		serial.begin(115200);
+		baud_settled.reset(now);
+	}
+
+	auto exit_settling(UiState) -> void {
+		auto const now = kev::Clock::now();
+		// Report success and failure alike, so every command gets a reply
+		commands.send(now, NexReply::ACK, UiCommand::SETUP, F("bkcmd=3"));
+		commands.send(now, NexReply::ACK, UiCommand::PAGE, F("page 0"));
+	}
+
+	auto handle_command_result(NexResult<UiCommand> const& result) -> void {
+		switch (result.tag) {
+		// The user has toggled the button, so it no longer shows what was
+		// last sent. Whatever the reply, the next refresh sends it again.
+		case UiCommand::GET_VALVE: {
+			shadow.forget(F("bt0"));
+			if (result.status != NexStatus::OK)
+				break;
+			if (result.number)
+				aqueduct_sm.event_valve_on();
+			else
+				aqueduct_sm.event_valve_off();
+		}; return;
+		case UiCommand::GET_PUMP: {
+			shadow.forget(F("bt1"));
+			if (result.status != NexStatus::OK)
+				break;
+			if (result.number)
+				aqueduct_sm.event_pump_on();
+			else
+				aqueduct_sm.event_pump_off();
+		}; return;
+		case UiCommand::SETUP: {
+			if (result.status == NexStatus::OK)
+				return;
+			// The display missed the baud change or the setup, nothing
+			// sent at this speed can be trusted to have arrived
+			if (result.status == NexStatus::TIMEOUT &&
+				setup_retries < SETUP_RETRIES) {
+				++setup_retries;
+				log(TOK("Setup timed out, connecting again"));
+				shadow.clear();
+				fsm.dispatch(*this, UiEvent::RECONNECT);
+				return;
+			}
+		}; break;
+		case UiCommand::PAGE: {
+			if (result.status == NexStatus::OK)
+				return;
+		}; break;
+		case UiCommand::SET: {
+			if (result.status == NexStatus::OK)
+				return;
+			// Unknown what the display shows now, send everything again
+			shadow.clear();
+		}; break;
+		}
+
+		log(TOK("Command "), command_text(result.tag), TOK(" "),
+			result.status == NexStatus::TIMEOUT ? TOK("timed out")
+												: TOK("failed"));
 	}
 
 	auto event_page_change(int page) -> void {
-		if (page >= static_cast<int>(UiState::LAST)) {
-			log("Error invalid page number");
+		auto event = UiEvent::LAST;
+		switch (static_cast<UiPage>(page)) {
+		case UiPage::HOME: event = UiEvent::SHOW_HOME; break;
+		case UiPage::STATUS: event = UiEvent::SHOW_STATUS; break;
+		case UiPage::ADVANCED: event = UiEvent::SHOW_ADVANCED; break;
+		case UiPage::AQUEDUCT: event = UiEvent::SHOW_AQUEDUCT; break;
+		}
+		for (uint8_t i = 0; event == UiEvent::LAST && i < TanksT::SIZE; ++i) {
+			if (tanks.info(i).select_page == page) {
+				tank = i;
+				event = UiEvent::SHOW_TANK;
+			}
+		}
+		if (event == UiEvent::LAST) {
+			log(TOK("Error invalid page number"));
 			return;
 		}
 
-		set_state(static_cast<UiState>(page));
+		shadow.clear();
+		fsm.dispatch(*this, event);
 	}
 
-	auto handle_button_press(int page, int id) -> void {
+	auto handle_button_press(int page, int id, Timestamp now) -> void {
 		if (page == 3 && id == 5)
 			event_next();
 		if (page == 3 && id == 6)
@@ -175,207 +400,193 @@ struct UiSm {
 			event_force_prev();
 		if (page == 4 && id == 1)
 			event_force_next();
-		if (page == 5 && id == 3) {
-			auto pressed = get_button_val("bt0");
-			if (pressed)
-				aqueduct_sm.event_valve_on();
-			else
-				aqueduct_sm.event_valve_off();
-		}
-		if (page == 5 && id == 4) {
-			auto pressed = get_button_val("bt1");
-			if (pressed)
-				aqueduct_sm.event_pump_on();
-			else
-				aqueduct_sm.event_pump_off();
-		}
+		// The new button state arrives later, see handle_command_result
+		if (page == 5 && id == 3)
+			get_button_val(now, F("bt0"), UiCommand::GET_VALVE);
+		if (page == 5 && id == 4)
+			get_button_val(now, F("bt1"), UiCommand::GET_PUMP);
 	}
 
-	auto get_button_val(char const* id) -> bool {
-		serial.print("get ");
-		serial.print(id);
-		serial.print(".val\xFF\xFF\xFF");
-		uint32_t ret = 0;
-		if (!recvRetNumber(serial, &ret)) {
-			log("Error reading button state for ", id);
-			return false;
+	auto get_button_val(Timestamp now, kev::FlashString id, UiCommand tag)
+		-> void {
+		if (!commands.send(now, NexReply::NUMBER, tag, F("get "), id,
+						   F(".val"))) {
+			log(TOK("Error reading button state for "), id);
 		}
-		return ret;
 	}
 
-	auto set_button_val(char const* id, bool val) -> void {
-		serial.print(id);
-		serial.print(".val=");
-		serial.print(val ? 1 : 0);
-		serial.print("\xFF\xFF\xFF");
+	auto set_button_val(Timestamp now, kev::FlashString id, bool val)
+		-> void {
+		if (!shadow.changed(id, val))
+			return;
+		if (commands.send(now, NexReply::ACK, UiCommand::SET, id, F(".val="),
+						  val ? 1 : 0)) {
+			shadow.store(id, val);
+		}
 	}
 
 	auto event_next() -> void {
-		switch (tank) {
-		case UiTank::A: return tank_a_sm.event_next();
-		case UiTank::B: return tank_b_sm.event_next();
-		}
-		log("Error during event_next");
+		tanks.visit(tank, [](auto& sm) { sm.event_next(); });
 	}
 
 	auto event_cancel() -> void {
-		switch (tank) {
-		case UiTank::A: return tank_a_sm.event_cancel();
-		case UiTank::B: return tank_b_sm.event_cancel();
-		}
-		log("Error during event_cancel");
+		tanks.visit(tank, [](auto& sm) { sm.event_cancel(); });
 	}
 
 	auto event_force_prev() -> void {
-		switch (tank) {
-		case UiTank::A: return tank_a_sm.event_force_prev_stage();
-		case UiTank::B: return tank_b_sm.event_force_prev_stage();
-		}
-		log("Error during event_force_prev");
+		tanks.visit(tank, [](auto& sm) { sm.event_force_prev_stage(); });
 	}
 
 	auto event_force_next() -> void {
-		switch (tank) {
-		case UiTank::A: return tank_a_sm.event_force_next_stage();
-		case UiTank::B: return tank_b_sm.event_force_next_stage();
-		}
-		log("Error during event_force_next");
+		tanks.visit(tank, [](auto& sm) { sm.event_force_next_stage(); });
 	}
 
-	auto set_state(UiState s) { state = s; }
-
-	auto log_raw(String const& raw) {
+	auto log_raw(NexFrame frame) {
 		log.partial_start();
-		log.partial("Raw UI command = ");
-		for (byte c : raw) {
-			Serial.print(c, HEX);
-			log.partial(" ");
+		log.partial(TOK("Raw UI command = "));
+		for (uint8_t i = 0; i < frame.size; ++i) {
+			log.partial(kev::Hex{frame.data[i]}, TOK(" "));
 		}
 		log.partial_end();
 	}
 
-	auto state_text() -> char const* {
-		switch (state) {
-		case UiState::HOME: return "HOME";
-		case UiState::WAITING_TANK_A: return "WAITING_TANK_A";
-		case UiState::WAITING_TANK_B: return "WAITING_TANK_B";
-		case UiState::STATUS: return "STATUS";
-		case UiState::ADVANCED: return "ADVANCED";
-		case UiState::AQUEDUCT: return "AQUEDUCT";
-		case UiState::LAST: return "LAST (error)";
-		}
-		return "UNKNOWN (error)";
-	}
+	auto state_text() -> kev::LogText { return Fsm::name(fsm.current()); }
 
-	auto tank_text() -> char const* {
-		switch (tank) {
-		case UiTank::A: return "A";
-		case UiTank::B: return "B";
+	auto command_text(UiCommand command) -> kev::LogText {
+		switch (command) {
+		case UiCommand::SETUP: return TOK("SETUP");
+		case UiCommand::PAGE: return TOK("PAGE");
+		case UiCommand::SET: return TOK("SET");
+		case UiCommand::GET_VALVE: return TOK("GET_VALVE");
+		case UiCommand::GET_PUMP: return TOK("GET_PUMP");
 		}
-		return "UNKNOWN (error)";
+		return TOK("UNKNOWN (error)");
 	}
 
-	auto tank_display() -> char const* {
-		switch (tank) {
-		case UiTank::A: return "Tanque 3 (3500L)";
-		case UiTank::B: return "Tanque 4 (2000L)";
-		}
-		return "UNKNOWN (error)";
+	auto tank_state() -> TankState {
+		return tanks.visit(tank, [](auto& sm) { return sm.get_state(); });
 	}
 
-	auto state_display() -> char const* {
-		switch (tank) {
-		case UiTank::A: return state_display_impl(tank_a_sm);
-		case UiTank::B: return state_display_impl(tank_b_sm);
-		}
-		log("Error during state_display");
-		return "Error de programa, informar";
+	// "Tanque 3 (3500L)"
+	auto tank_display() -> UiText {
+		auto const info = tanks.info(tank);
+		auto text = UiText{};
+		text.append(info.name)
+			.append(F(" ("))
+			.append(static_cast<unsigned long>(info.capacity_l))
+			.append(F("L)"));
+		return text;
 	}
 
-	template <class TankSM>
-	auto state_display_impl(TankSM& tank_sm) -> char const* {
-		switch (tank_sm.get_state()) {
-		case TankState::INITIAL: return "Espera inicial";
-		case TankState::PRE_FILL: return "Pre-llenado";
-		case TankState::FILLING: return "Llenando";
+	auto state_display() -> kev::FlashString {
+		switch (tank_state()) {
+		case TankState::INITIAL: return F("Espera inicial");
+		case TankState::PRE_FILL: return F("Pre-llenado");
+		case TankState::FILLING: return F("Llenando");
 		case TankState::CHEM_1:
-			return "Recirculando hidroxicloruro de aluminio";
-		case TankState::CHEM_2: return "Recirculando hipoclorito de sodio";
+			return F("Recirculando hidroxicloruro de aluminio");
+		case TankState::CHEM_2: return F("Recirculando hipoclorito de sodio");
 		case TankState::WAITING_CHEM_1:
 		case TankState::WAITING_CHEM_2:
-		case TankState::WAITING_IN_PROCESS: return "Esperando confirmacion";
-		case TankState::IN_PROCESS: return "En proceso";
-		case TankState::LAST: return "Error de programa, informar";
+		case TankState::WAITING_IN_PROCESS: return F("Esperando confirmacion");
+		case TankState::IN_PROCESS: return F("En proceso");
+		case TankState::LAST: return F("Error de programa, informar");
 		}
-		return "Error de programa, informar";
+		return F("Error de programa, informar");
 	}
 
-	auto additional_display(Timestamp now) -> String {
-		switch (tank) {
-		case UiTank::A: return additional_display_impl(tank_a_sm, now);
-		case UiTank::B: return additional_display_impl(tank_b_sm, now);
-		}
-		log("Error during additional_display");
-		return "Error de programa, informar";
+	auto additional_display(Timestamp now) -> UiText {
+		auto text = UiText{};
+		tanks.visit(tank, [&](auto& sm) {
+			additional_display_impl(sm, now, text);
+		});
+		return text;
 	}
 
 	template <class TankSM>
-	auto additional_display_impl(TankSM& tank_sm, Timestamp now) -> String {
+	auto additional_display_impl(TankSM& tank_sm, Timestamp now, UiText& out)
+		-> void {
 		switch (tank_sm.get_state()) {
-		case TankState::INITIAL:
-		case TankState::PRE_FILL: return "";
-		case TankState::FILLING:
-			return "Tiempo de seguridad = " + tank_sm.display_fill_timer(now);
-		case TankState::CHEM_1:
-			return "Tiempo = " + tank_sm.display_chem1_timer(now);
-		case TankState::CHEM_2:
-			return "Tiempo = " + tank_sm.display_chem2_timer(now);
-		case TankState::WAITING_CHEM_1:
-			return "Confirmar hidroxicloruro de aluminio";
-		case TankState::WAITING_CHEM_2: return "Confirmar hipoclorito de sodio";
-		case TankState::WAITING_IN_PROCESS:
-			return "Confirmar puesta en proceso";
-		case TankState::IN_PROCESS:
-			return "Corfirmar para sacar este tanque de proceso";
-		case TankState::LAST: return "Error de programa, informar";
-		}
-		return "Error de programa, informar";
-	}
-
-	auto confirm_display() -> char const* {
-		switch (tank) {
-		case UiTank::A: return confirm_display_impl(tank_a_sm);
-		case UiTank::B: return confirm_display_impl(tank_b_sm);
+		case TankState::INITIAL: {
+			// Another tank is filling, this one starts right after
+			auto const position = tank_sm.fill_position();
+			if (position != kev::Arbiter::NONE && position > 0) {
+				out.append(F("En cola para llenado, lugar "));
+				out.append(static_cast<int>(position));
+			}
+		}; return;
+		case TankState::PRE_FILL: return;
+		case TankState::FILLING: {
+			out.append(F("Tiempo de seguridad = "));
+			tank_sm.display_fill_timer(now, out);
+		}; return;
+		case TankState::CHEM_1: {
+			out.append(F("Tiempo = "));
+			tank_sm.display_chem1_timer(now, out);
+		}; return;
+		case TankState::CHEM_2: {
+			out.append(F("Tiempo = "));
+			tank_sm.display_chem2_timer(now, out);
+		}; return;
+		case TankState::WAITING_CHEM_1: {
+			out.append(F("Confirmar hidroxicloruro de aluminio"));
+		}; return;
+		case TankState::WAITING_CHEM_2: {
+			out.append(F("Confirmar hipoclorito de sodio"));
+		}; return;
+		case TankState::WAITING_IN_PROCESS: {
+			// Behind the tank in process, it goes in by itself when its turn
+			// comes
+			auto const position = tank_sm.in_process_position();
+			if (position == kev::Arbiter::NONE || position == 0) {
+				out.append(F("Confirmar puesta en proceso"));
+			} else {
+				out.append(F("En cola para proceso, lugar "));
+				out.append(static_cast<int>(position));
+			}
+		}; return;
+		case TankState::IN_PROCESS: {
+			out.append(F("Corfirmar para sacar este tanque de proceso"));
+		}; return;
+		case TankState::LAST: break;
 		}
-		log("Error during confirm_display");
-		return "Error de programa, informar";
+		out.append(F("Error de programa, informar"));
 	}
 
-	template <class TankSM>
-	auto confirm_display_impl(TankSM& tank_sm) -> char const* {
-		switch (tank_sm.get_state()) {
-		case TankState::INITIAL: return "Llenar";
+	auto confirm_display() -> kev::FlashString {
+		switch (tank_state()) {
+		case TankState::INITIAL: return F("Llenar");
 		case TankState::PRE_FILL:
 		case TankState::FILLING:
 		case TankState::CHEM_1:
-		case TankState::CHEM_2: return "";
+		case TankState::CHEM_2: return F("");
 		case TankState::WAITING_CHEM_1:
-		case TankState::WAITING_CHEM_2: return "Confirmar";
-		case TankState::WAITING_IN_PROCESS: return "Poner en proceso";
-		case TankState::IN_PROCESS: return "Sacar de proceso";
-		case TankState::LAST: return "Error de programa, informar";
+		case TankState::WAITING_CHEM_2: return F("Confirmar");
+		case TankState::WAITING_IN_PROCESS: return F("Poner en proceso");
+		case TankState::IN_PROCESS: return F("Sacar de proceso");
+		case TankState::LAST: return F("Error de programa, informar");
 		}
-		return "Error de programa, informar";
+		return F("Error de programa, informar");
 	}
 
-	UiState state = UiState::HOME;
-	HardwareSerial& serial;
-	TankASM& tank_a_sm;
-	TankBSM& tank_b_sm;
-	AqueductSM& aqueduct_sm;
-	Log<> log{"ui"};
+	// The baud command is 14 bytes, 14.6 ms at 9600
+	static constexpr auto BAUD_SEND = 20_ms;
+	static constexpr auto BAUD_SETTLE = 50_ms;
+	static constexpr uint8_t SETUP_RETRIES = 3;
 
-	UiTank tank = UiTank::A;
-	Timer status_update_timer = {1_s};
-	Timer aq_update_timer = {1_s};
+	Fsm fsm;
+	SerialT& serial;
+	TanksT& tanks;
+	AqueductSM& aqueduct_sm;
+	Log<> log{TOK("ui")};
+	NextionParser<> parser;
+	NexCommands<SerialT, UiCommand> commands;
+	NexShadow<> shadow;
+	uint16_t lost_replies = 0;
+	uint8_t setup_retries = 0;
+	Timer baud_sent{BAUD_SEND};
+	Timer baud_settled{BAUD_SETTLE};
+
+	// Index into `tanks` of the one on the status page
+	uint8_t tank = 0;
 };
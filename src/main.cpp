@@ -2,12 +2,18 @@ constexpr auto version = "Version 1.5 (04/Ene/2026)";
 
 #include <Arduino.h>
 #include "AqueductSM.h"
+#include "Clock.h"
 #include "DirectIO.h"
 #include "HardwareSerial.h"
-#include "Mutex.h"
+#include "Arbiter.h"
+#include "InputDebouncer.h"
+#include "OutputStage.h"
 #include "Persist.h"
 #include "SharedOutput.h"
+#include "Scheduler.h"
+#include "Snapshot.h"
 #include "TankSM.h"
+#include "Tanks.h"
 #include "Timer.h"
 #include "UiSerial.h"
 #include "UiSm.h"
@@ -16,131 +22,229 @@ using namespace kev::literals;
 using kev::Timestamp;
 
 auto led_output = Output<LED_BUILTIN>{};
-auto out_fill_pump = OutputLow<35>{};
+
+// Pumps and valves move together at the end of each pass of the loop, see
+// kev::OutputStage
+auto output_stage = kev::OutputStage{};
+using kev::StagedOutputLow;
+
+// Level sensors, active low, have to hold a level for 5 s. They are sampled
+// together from the Timer0 compare interrupt, see ISR below.
+auto sensors = kev::InputDebouncer{5_s};
+using kev::DebouncedInput;
+
+// One fill pump for every tank, each gets a handle in tank order
+auto out_fill_pump = StagedOutputLow<35>{output_stage};
 auto out_fill_pump_shared =
-	SharedOutput<decltype(out_fill_pump)>{out_fill_pump};
-auto out_fill_pump_shared_a =
-	SharedOutputA<decltype(out_fill_pump_shared)>{out_fill_pump_shared};
-auto out_fill_pump_shared_b =
-	SharedOutputB<decltype(out_fill_pump_shared)>{out_fill_pump_shared};
-
-auto in_process_mutex = Mutex{};
-
-auto out_recir_pump_a = OutputLow<29>{};
-auto out_ingress_valve_a = OutputLow<23>{};
-auto out_process_valve_a = OutputLow<9>{};
-auto in_sensor_hi_a = InputLow<22>{};
-
-auto out_recir_pump_b = OutputLow<31>{};
-auto out_ingress_valve_b = OutputLow<25>{};
-auto out_process_valve_b = OutputLow<10>{};
-auto in_sensor_hi_b = InputLow<24>{};
-
-auto out_aq_ingress_valve = OutputLow<27>{};
-auto out_aq_pump = OutputLow<33>{};
-auto in_aq_sensor_hi = InputLow<26>{};
-auto in_aq_sensor_lo = InputLow<32>{};
-
-auto led_timer = kev::Timer{1_s};
-
-auto persist_state_tank_a = PersistByte<0>{};
-auto persist_state_tank_b = PersistByte<1>{};
-
-auto tank_a_sm = TankSM<decltype(out_fill_pump_shared_a),
-						decltype(out_recir_pump_a),
-						decltype(out_ingress_valve_a),
-						decltype(out_process_valve_a),
-						decltype(in_sensor_hi_a),
-						decltype(in_aq_sensor_lo),
-						decltype(persist_state_tank_a)>{
-	"tank_a",
-	out_fill_pump_shared_a,
+	SharedOutput<decltype(out_fill_pump), 2>{out_fill_pump};
+auto out_fill_pump_a = out_fill_pump_shared.handle<0>();
+auto out_fill_pump_b = out_fill_pump_shared.handle<1>();
+
+// Tanks fill one at a time with the whole pump flow, the next in line
+// starts as soon as the current fill ends
+auto fill_pump_line = kev::Arbiter{};
+
+// One tank at a time feeds the process line, the others wait their turn
+auto in_process_line = kev::Arbiter{};
+
+auto out_recir_pump_a = StagedOutputLow<29>{output_stage};
+auto out_ingress_valve_a = StagedOutputLow<23>{output_stage};
+auto out_process_valve_a = StagedOutputLow<9>{output_stage};
+auto in_sensor_hi_a = DebouncedInput{sensors, 22, true};
+
+auto out_recir_pump_b = StagedOutputLow<31>{output_stage};
+auto out_ingress_valve_b = StagedOutputLow<25>{output_stage};
+auto out_process_valve_b = StagedOutputLow<10>{output_stage};
+auto in_sensor_hi_b = DebouncedInput{sensors, 24, true};
+
+auto out_aq_ingress_valve = StagedOutputLow<27>{output_stage};
+auto out_aq_pump = StagedOutputLow<33>{output_stage};
+auto in_aq_sensor_hi = DebouncedInput{sensors, 26, true};
+auto in_aq_sensor_lo = DebouncedInput{sensors, 32, true};
+
+auto tank_a_sm = TankSM{
+	TOK("tank_a"),
+	out_fill_pump_a,
 	out_recir_pump_a,
 	out_ingress_valve_a,
 	out_process_valve_a,
 	in_sensor_hi_a,
 	in_aq_sensor_lo,
-	persist_state_tank_a,
-	in_process_mutex,
+	fill_pump_line.handle(0),
+	in_process_line.handle(0),
 };
 
-auto tank_b_sm = TankSM<decltype(out_fill_pump_shared_b),
-						decltype(out_recir_pump_b),
-						decltype(out_ingress_valve_b),
-						decltype(out_process_valve_b),
-						decltype(in_sensor_hi_b),
-						decltype(in_aq_sensor_lo),
-						decltype(persist_state_tank_b)>{
-	"tank_b",
-	out_fill_pump_shared_b,
+auto tank_b_sm = TankSM{
+	TOK("tank_b"),
+	out_fill_pump_b,
 	out_recir_pump_b,
 	out_ingress_valve_b,
 	out_process_valve_b,
 	in_sensor_hi_b,
 	in_aq_sensor_lo,
-	persist_state_tank_b,
-	in_process_mutex,
+	fill_pump_line.handle(1),
+	in_process_line.handle(1),
 };
 
-auto aqueduct_sm = AqueductSM<decltype(out_aq_ingress_valve),
-							  decltype(out_aq_pump),
-							  decltype(in_aq_sensor_hi)>{
-	out_aq_ingress_valve, out_aq_pump, in_aq_sensor_hi};
+// The plant, in the order tanks go everywhere else: console ids, display
+// pages and the EEPROM snapshot. A new tank is a line here plus its pins and
+// state machine above, and a page on the display that selects it.
+constexpr kev::TankInfo tank_infos[] PROGMEM = {
+	{"Tanque 3", 3500, 'a', 1},
+	{"Tanque 4", 2000, 'b', 2},
+};
 
-auto ui = UiSm<decltype(tank_a_sm), decltype(tank_b_sm), decltype(aqueduct_sm)>{
-	Serial3, tank_a_sm, tank_b_sm, aqueduct_sm};
+auto tanks = kev::Tanks<decltype(tank_a_sm), decltype(tank_b_sm)>{
+	tank_infos, tank_a_sm, tank_b_sm};
+
+auto aqueduct_sm =
+	AqueductSM<decltype(out_aq_ingress_valve), decltype(out_aq_pump)>{
+		out_aq_ingress_valve, out_aq_pump, in_aq_sensor_hi};
+
+// EEPROM bytes 0 and 1 hold the tank states of older versions, see
+// PlantPersist::restore(). The record grows with each tank: when the number
+// of tanks changes, move the journal past the old one.
+using Snapshot = PlantSnapshot<decltype(tanks)::SIZE>;
+auto snapshot_journal = kev::EepromJournal<Snapshot, 16, 200>{};
+auto plant_persist = PlantPersist<decltype(tanks),
+								  decltype(aqueduct_sm),
+								  decltype(snapshot_journal)>{
+	tanks, aqueduct_sm, snapshot_journal};
+
+auto ui = UiSm<decltype(tanks), decltype(aqueduct_sm)>{Serial3, tanks,
+													   aqueduct_sm};
+
+auto log_ = Log<>{TOK("main")};
+
+auto tanks_task(Timestamp now) -> void;
+auto aqueduct_task(Timestamp now) -> void;
+auto ui_task(Timestamp now) -> void;
+auto ui_refresh_task(Timestamp now) -> void;
+auto ui_serial_task(Timestamp now) -> void;
+auto serial_log(Timestamp now) -> void;
+auto log_drain_task(Timestamp now) -> void;
+auto led(Timestamp now) -> void;
+auto persist_task(Timestamp now) -> void;
+
+auto tanks_deadline(Timestamp now) -> Timestamp;
+auto aqueduct_deadline(Timestamp now) -> Timestamp;
+auto ui_deadline(Timestamp now) -> Timestamp;
+auto ui_serial_deadline(Timestamp now) -> Timestamp;
+auto log_drain_deadline(Timestamp now) -> Timestamp;
+
+#ifdef KEV_BENCH
+// bench/Benchmarks.h, runs in place of the main loop, see `make bench`
+auto run_benchmarks() -> void;
+#endif
+
+using kev::Task;
+using kev::TaskPriority;
+
+// Tanks first, then the operator interfaces, then whatever is left
+auto scheduler = kev::Scheduler<9>{
+	{
+		Task{TOK("tanks"), tanks_task, 0_ms, TaskPriority::CONTROL,
+			 500 * decltype(tanks)::SIZE, tanks_deadline},
+		Task{TOK("aqueduct"), aqueduct_task, 0_ms, TaskPriority::CONTROL, 500,
+			 aqueduct_deadline},
+		Task{TOK("ui"), ui_task, 0_ms, TaskPriority::UI, 2000, ui_deadline},
+		Task{TOK("ui_refresh"), ui_refresh_task, 1_s, TaskPriority::UI, 3000},
+		Task{TOK("ui_serial"), ui_serial_task, 0_ms, TaskPriority::UI, 1000,
+			 ui_serial_deadline},
+		Task{TOK("serial_log"), serial_log, 2_s, TaskPriority::BACKGROUND,
+			 5000},
+		Task{TOK("log_drain"), log_drain_task, 0_ms, TaskPriority::BACKGROUND,
+			 500, log_drain_deadline},
+		Task{TOK("led"), led, 1_s, TaskPriority::BACKGROUND, 100},
+		Task{TOK("persist"), persist_task, 100_ms, TaskPriority::BACKGROUND,
+			 200},
+	},
+	5000,
+};
 
 auto ui_serial =
-	UiSerial<decltype(tank_a_sm), decltype(tank_b_sm), decltype(aqueduct_sm)>{
-		tank_a_sm, tank_b_sm, aqueduct_sm};
+	UiSerial<decltype(tanks), decltype(aqueduct_sm), decltype(scheduler)>{
+		tanks, aqueduct_sm, scheduler};
 
-auto log_ = Log<>{"main"};
-auto log_timer = kev::Timer{2_s};
+// One pass of the main loop, up to going to sleep
+auto loop_pass() -> void {
+	scheduler.run(kev::Clock::now());
+	output_stage.commit();
 
-auto led(Timestamp now) -> void;
-auto serial_log(Timestamp now) -> void;
+	serialEventRun();
+}
 
 auto main() -> int {
 	init();
 
 	Serial.begin(115200);
 	log_(version);
-	tank_a_sm.restore_state();
-	tank_b_sm.restore_state();
+	plant_persist.restore(kev::Clock::now());
+	output_stage.commit();
 	ui.init();
-	log_("Setup done");
+	kev::start_input_sampling();
+	log_(TOK("Setup done"));
+
+#ifdef KEV_BENCH
+	run_benchmarks();
+#endif
 
 	for (;;) {
-		auto now = kev::Timestamp{millis()};
+		loop_pass();
 
-		led(now);
+		scheduler.idle([] {
+			return Serial.available() > 0 || Serial3.available() > 0 ||
+				   sensors.take_changed();
+		});
+	}
+}
 
-		tank_a_sm.tick(now);
-		tank_b_sm.tick(now);
-		aqueduct_sm.tick(now);
-		ui.tick(now);
-		ui_serial.tick();
+ISR(EE_READY_vect) { kev::eeprom_writer.pump(); }
 
-		serial_log(now);
+ISR(TIMER0_COMPA_vect) { sensors.tick(); }
 
-		serialEventRun();
-	}
+auto tanks_task(Timestamp now) -> void {
+	tanks.for_each([now](uint8_t, auto& tank) { tank.tick(now); });
+}
+auto aqueduct_task(Timestamp now) -> void { aqueduct_sm.tick(now); }
+auto ui_task(Timestamp now) -> void { ui.tick(now); }
+auto ui_refresh_task(Timestamp now) -> void { ui.refresh(now); }
+auto ui_serial_task(Timestamp) -> void { ui_serial.tick(); }
+auto log_drain_task(Timestamp) -> void { kev::log_buffer.drain(Serial); }
+
+auto tanks_deadline(Timestamp now) -> Timestamp {
+	return tanks.next_deadline(now);
+}
+auto aqueduct_deadline(Timestamp now) -> Timestamp {
+	return aqueduct_sm.next_deadline(now);
+}
+auto ui_deadline(Timestamp now) -> Timestamp { return ui.next_deadline(now); }
+auto ui_serial_deadline(Timestamp now) -> Timestamp {
+	return ui_serial.next_deadline(now);
+}
+auto log_drain_deadline(Timestamp now) -> Timestamp {
+	return kev::log_buffer.pending() ? now : now + kev::NO_DEADLINE;
 }
 
-auto led(Timestamp now) -> void {
-	if (led_timer.isDone(now)) {
-		led_timer.reset(now);
-		digitalWrite(13, !digitalRead(13));
-	}
+auto persist_task(Timestamp now) -> void { plant_persist.tick(now); }
+
+auto led(Timestamp) -> void {
+	digitalWrite(13, !digitalRead(13));
 }
 
 auto serial_log(Timestamp now) -> void {
-	if (log_timer.isDone(now)) {
-		log_timer.reset(now);
-		tank_a_sm.log_debug(now);
-		tank_b_sm.log_debug(now);
-		aqueduct_sm.log_debug();
-		ui.log_debug();
-		println();
+	tanks.for_each([now](uint8_t, auto& tank) { tank.log_debug(now); });
+	out_fill_pump_shared.report(log_, TOK("Fill pump"), now);
+	output_stage.report(log_);
+	aqueduct_sm.log_debug();
+	ui.log_debug();
+	log_(TOK("Uptime s = "), kev::Clock::uptime_s());
+	if (auto const lost = kev::log_buffer.overflows()) {
+		log_(TOK("Log buffer overflows = "), lost);
 	}
+	println();
 }
+
+#ifdef KEV_BENCH
+#include "Benchmarks.h"
+#endif
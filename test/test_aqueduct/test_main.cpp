@@ -0,0 +1,82 @@
+// AqueductSM on the host. Its outputs change as soon as an event moves it
+// to another state, as they did before it ran on kev::Fsm.
+
+#include <unity.h>
+#include "AqueductSM.h"
+#include "InputDebouncer.h"
+#include "Switch.h"
+
+using namespace kev::literals;
+using kev::Switch;
+
+namespace {
+
+struct Aqueduct {
+	kev::InputDebouncer sensors{5_s};
+	Switch valve;
+	Switch pump;
+	AqueductSM<Switch, Switch> sm{valve, pump,
+								  kev::DebouncedInput{sensors, 26, true}};
+};
+
+auto deadline_is_now(Aqueduct& aq, Timestamp now) -> bool {
+	return aq.sm.next_deadline(now).unsafeGetValue() == now.unsafeGetValue();
+}
+
+}  // namespace
+
+void setUp() {}
+void tearDown() {}
+
+auto test_outputs_follow_events() -> void {
+	auto aq = Aqueduct{};
+	auto const now = Timestamp{1000};
+	aq.sm.tick(now);
+	TEST_ASSERT_FALSE(deadline_is_now(aq, now));
+
+	aq.sm.event_valve_on();
+	TEST_ASSERT_TRUE(aq.sm.get_state() == AqState::FILLING);
+	TEST_ASSERT_TRUE(aq.valve.on);
+	TEST_ASSERT_TRUE(aq.sm.get_valve());
+	TEST_ASSERT_FALSE(aq.pump.on);
+	// Nothing is left for the next tick
+	TEST_ASSERT_FALSE(deadline_is_now(aq, now));
+
+	aq.sm.event_pump_on();
+	TEST_ASSERT_TRUE(aq.valve.on);
+	TEST_ASSERT_TRUE(aq.pump.on);
+	TEST_ASSERT_TRUE(aq.sm.get_pump());
+
+	aq.sm.event_valve_off();
+	TEST_ASSERT_FALSE(aq.valve.on);
+	TEST_ASSERT_FALSE(aq.pump.on);
+	TEST_ASSERT_FALSE(aq.sm.get_valve());
+	TEST_ASSERT_FALSE(aq.sm.get_pump());
+}
+
+// Each of several events between ticks sets the outputs of its state
+auto test_events_between_ticks_apply_in_order() -> void {
+	auto aq = Aqueduct{};
+	auto const now = Timestamp{1000};
+	aq.sm.tick(now);
+
+	aq.sm.event_pump_on();
+	TEST_ASSERT_TRUE(aq.sm.get_state() == AqState::FILLING_PUMP);
+	TEST_ASSERT_TRUE(aq.valve.on);
+	TEST_ASSERT_TRUE(aq.pump.on);
+
+	aq.sm.event_pump_off();
+	TEST_ASSERT_TRUE(aq.valve.on);
+	TEST_ASSERT_FALSE(aq.pump.on);
+
+	aq.sm.tick(now);
+	TEST_ASSERT_TRUE(aq.valve.on);
+	TEST_ASSERT_FALSE(aq.pump.on);
+}
+
+auto main() -> int {
+	UNITY_BEGIN();
+	RUN_TEST(test_outputs_follow_events);
+	RUN_TEST(test_events_between_ticks_apply_in_order);
+	return UNITY_END();
+}
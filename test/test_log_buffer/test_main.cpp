@@ -0,0 +1,119 @@
+// LogBuffer making room in a tokenized log. The format is picked at compile
+// time, this file builds with KEV_LOG_TOKENIZED.
+#define KEV_LOG_TOKENIZED
+
+#include <string.h>
+#include <unity.h>
+#include "LogBuffer.h"
+
+namespace {
+
+// What drain() hands on, taking up to `room` bytes in all
+struct Sink {
+	auto availableForWrite() -> int { return static_cast<int>(room - size); }
+	auto write(uint8_t const* data, size_t n) -> size_t {
+		memcpy(bytes + size, data, n);
+		size += n;
+		return n;
+	}
+
+	uint8_t bytes[64] = {};
+	size_t size = 0;
+	size_t room = sizeof(bytes);
+};
+
+// Name 0x0A0A with UINT 10 and UINT 1290: every byte but the tags reads as
+// END
+constexpr uint8_t NEWLINES[] = {
+	0xFE, 0x0A, 0x0A, 0x03, 0x0A, 0x03, 0x8A, 0x0A, 0x0A};
+// A STRING of "\n" and 0xFE
+constexpr uint8_t STRING[] = {0xFE, 0x01, 0x00, 0x04, 0x02, 0x0A, 0xFE, 0x0A};
+// A CHAR
+constexpr uint8_t SHORT[] = {0xFE, 0x02, 0x00, 0x05, 'c', 0x0A};
+
+template <class Buffer, size_t N>
+auto put(Buffer& buffer, uint8_t const (&bytes)[N]) -> void {
+	buffer.write(bytes, N);
+}
+
+template <size_t N>
+auto take(Sink const& sink, size_t& at, uint8_t const (&entry)[N]) -> void {
+	TEST_ASSERT_EQUAL_MEMORY(entry, sink.bytes + at, N);
+	at += N;
+}
+
+// Checks `sink` got exactly the entries given
+template <size_t... N>
+auto received(Sink const& sink, uint8_t const (&... entries)[N]) -> void {
+	TEST_ASSERT_EQUAL(0 + ... + N, sink.size);
+	size_t at = 0;
+	(take(sink, at, entries), ...);
+}
+
+// Drains `buffer` and checks it held exactly the entries given
+template <class Buffer, size_t... N>
+auto expect(Buffer& buffer, uint8_t const (&... entries)[N]) -> void {
+	auto sink = Sink{};
+	buffer.drain(sink);
+	received(sink, entries...);
+}
+
+}  // namespace
+
+void setUp() {}
+void tearDown() {}
+
+auto test_drops_frame_with_end_in_payload() -> void {
+	auto buffer = kev::LogBuffer<24>{};
+	put(buffer, NEWLINES);
+	put(buffer, STRING);
+	put(buffer, SHORT);
+	put(buffer, SHORT);
+	TEST_ASSERT_EQUAL(1, buffer.overflows());
+	expect(buffer, STRING, SHORT, SHORT);
+}
+
+auto test_drops_frame_with_frame_start_in_payload() -> void {
+	auto buffer = kev::LogBuffer<16>{};
+	put(buffer, STRING);
+	put(buffer, SHORT);
+	put(buffer, SHORT);
+	TEST_ASSERT_EQUAL(1, buffer.overflows());
+	expect(buffer, SHORT, SHORT);
+}
+
+auto test_drops_plain_text_line_before_frames() -> void {
+	constexpr uint8_t LINE[] = {'o', 'k', '\n'};
+	auto buffer = kev::LogBuffer<16>{};
+	put(buffer, LINE);
+	put(buffer, NEWLINES);
+	put(buffer, SHORT);
+	TEST_ASSERT_EQUAL(1, buffer.overflows());
+	expect(buffer, NEWLINES, SHORT);
+}
+
+// The UART took only the start of a frame, the rest of it has to follow
+// unbroken however full the buffer gets
+auto test_keeps_frame_being_sent_whole() -> void {
+	auto buffer = kev::LogBuffer<24>{};
+	auto wire = Sink{};
+	put(buffer, NEWLINES);
+	put(buffer, SHORT);
+	wire.room = 3;
+	buffer.drain(wire);
+	put(buffer, STRING);
+	put(buffer, SHORT);
+	TEST_ASSERT_EQUAL(1, buffer.overflows());
+	wire.room = sizeof(wire.bytes);
+	buffer.drain(wire);
+	received(wire, NEWLINES, STRING, SHORT);
+}
+
+auto main() -> int {
+	UNITY_BEGIN();
+	RUN_TEST(test_drops_frame_with_end_in_payload);
+	RUN_TEST(test_drops_frame_with_frame_start_in_payload);
+	RUN_TEST(test_drops_plain_text_line_before_frames);
+	RUN_TEST(test_keeps_frame_being_sent_whole);
+	return UNITY_END();
+}
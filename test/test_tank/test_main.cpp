@@ -0,0 +1,131 @@
+// TankSM on the host: two tanks sharing the fill pump line and the process
+// line, wired as in main.cpp with plain switches for the outputs.
+
+#include <unity.h>
+#include "Arbiter.h"
+#include "InputDebouncer.h"
+#include "Switch.h"
+#include "TankSM.h"
+
+using namespace kev::literals;
+using kev::Switch;
+
+namespace {
+
+struct TankOutputs {
+	Switch fill_pump;
+	Switch recir_pump;
+	Switch ingress_valve;
+	Switch process_valve;
+};
+
+struct Plant {
+	kev::InputDebouncer sensors{5_s};
+	kev::Arbiter fill_line;
+	kev::Arbiter in_process_line;
+	TankOutputs a;
+	TankOutputs b;
+
+	TankSM tank_a{TOK("tank_a"),
+				  a.fill_pump,
+				  a.recir_pump,
+				  a.ingress_valve,
+				  a.process_valve,
+				  kev::DebouncedInput{sensors, 22, true},
+				  kev::DebouncedInput{sensors, 32, true},
+				  fill_line.handle(0),
+				  in_process_line.handle(0)};
+	TankSM tank_b{TOK("tank_b"),
+				  b.fill_pump,
+				  b.recir_pump,
+				  b.ingress_valve,
+				  b.process_valve,
+				  kev::DebouncedInput{sensors, 24, true},
+				  kev::DebouncedInput{sensors, 32, true},
+				  fill_line.handle(1),
+				  in_process_line.handle(1)};
+};
+
+auto state_of(TankState s) -> uint8_t { return static_cast<uint8_t>(s); }
+
+}  // namespace
+
+void setUp() {}
+void tearDown() {}
+
+// A NEXT from the console is dispatched after the tanks task ran in that
+// pass, so persistence can take a snapshot before the entry action resets
+// the new state's timer
+auto test_snapshot_between_dispatch_and_tick() -> void {
+	auto plant = Plant{};
+	auto& tank = plant.tank_a;
+	auto const start = Timestamp{1000};
+	tank.resume(TankSnapshot{state_of(TankState::CHEM_1), 0}, start);
+	tank.tick(start + 30_min);
+	tank.event_cancel();
+	tank.tick(start + 30_min);
+	TEST_ASSERT_EQUAL(state_of(TankState::WAITING_CHEM_1),
+					  state_of(tank.get_state()));
+
+	auto const now = start + 120_min;
+	tank.event_next();
+	auto snapshot = tank.snapshot(now);
+	TEST_ASSERT_EQUAL(state_of(TankState::CHEM_1), snapshot.state);
+	TEST_ASSERT_EQUAL(0, snapshot.elapsed_s);
+
+	tank.tick(now);
+	snapshot = tank.snapshot(now + 10_s);
+	TEST_ASSERT_EQUAL(10, snapshot.elapsed_s);
+}
+
+// Only one tank feeds the process line: the one leaving IN_PROCESS closes
+// its valve before the next in line opens its own
+auto test_in_process_handover_closes_valve() -> void {
+	auto plant = Plant{};
+	auto const now = Timestamp{1000};
+	auto one_valve_open = [&] {
+		return !(plant.a.process_valve && plant.b.process_valve);
+	};
+
+	plant.tank_a.resume(TankSnapshot{state_of(TankState::IN_PROCESS), 0},
+						now);
+	plant.tank_b.resume(
+		TankSnapshot{state_of(TankState::WAITING_IN_PROCESS), 0}, now);
+	plant.tank_b.event_next();
+	plant.tank_b.tick(now);
+	TEST_ASSERT_TRUE(plant.a.process_valve);
+	TEST_ASSERT_FALSE(plant.b.process_valve);
+	TEST_ASSERT_EQUAL(1, plant.tank_b.in_process_position());
+
+	plant.tank_a.event_next();
+	TEST_ASSERT_FALSE(plant.a.process_valve);
+	for (uint8_t pass = 0; pass < 3; ++pass) {
+		plant.tank_a.tick(now);
+		TEST_ASSERT_TRUE(one_valve_open());
+		plant.tank_b.tick(now);
+		TEST_ASSERT_TRUE(one_valve_open());
+	}
+	TEST_ASSERT_TRUE(plant.tank_b.get_state() == TankState::IN_PROCESS);
+	TEST_ASSERT_TRUE(plant.b.process_valve);
+	TEST_ASSERT_FALSE(plant.a.process_valve);
+}
+
+// A fill interrupted by a power loss goes on with the pump feeding through
+// an open valve, as it did before
+auto test_resume_into_filling_opens_valve() -> void {
+	auto plant = Plant{};
+	auto const now = Timestamp{1000};
+	plant.tank_a.resume(TankSnapshot{state_of(TankState::FILLING), 60}, now);
+	plant.tank_a.tick(now);
+	TEST_ASSERT_TRUE(plant.tank_a.get_state() == TankState::FILLING);
+	TEST_ASSERT_TRUE(plant.a.fill_pump);
+	TEST_ASSERT_TRUE(plant.a.ingress_valve);
+}
+
+auto main() -> int {
+	UNITY_BEGIN();
+	RUN_TEST(test_snapshot_between_dispatch_and_tick);
+	RUN_TEST(test_in_process_handover_closes_valve);
+	RUN_TEST(test_resume_into_filling_opens_valve);
+	return UNITY_END();
+}
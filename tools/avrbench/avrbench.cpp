@@ -0,0 +1,295 @@
+// Runs the bench build of the firmware (env:bench, see bench/Bench.h) under
+// simavr and counts the exact CPU cycles of each benchmark. The counts are
+// compared with a baseline: any that grew by more than the threshold fails
+// the run, so a slower hot path shows up before it reaches the plant.
+//
+//   avrbench [-b BASELINE] [-t PERCENT] [-u] FIRMWARE.elf
+//
+// -b  baseline file, lines of "<cycles> <name>", # starts a comment
+// -t  regression threshold in percent, 1 by default
+// -u  write the counts to BASELINE instead of comparing with it
+//
+// A BASELINE without counts yet gets them written as with -u, and the run
+// says so: the first run on a machine with simavr records the baseline to
+// commit, every later one compares with it.
+//
+// Exits with 1 on a regression, 2 when the firmware cannot be run. Counts
+// under simavr are exact and repeat from run to run, so the threshold only
+// has to allow for changes one is willing to accept.
+
+#include <simavr/avr_uart.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// I/O registers as data space addresses on the ATmega2560
+constexpr avr_io_addr_t GPIOR0 = 0x3E;
+constexpr avr_io_addr_t GPIOR1 = 0x4A;
+constexpr avr_io_addr_t GPIOR2 = 0x4B;
+
+// Same as bench::Mark
+constexpr uint8_t MARK_STOP = 0;
+constexpr uint8_t MARK_START = 1;
+constexpr uint8_t MARK_DONE = 2;
+
+// The name bench::calibrate() gives the empty benchmark
+constexpr auto EMPTY = "(empty)";
+
+// A minute of simulated time. The benchmarks take a fraction of a second,
+// a firmware that runs this long is stuck.
+constexpr avr_cycle_count_t CYCLE_LIMIT = 60ull * 16000000;
+
+struct Options {
+	char const* baseline = "bench/baseline.txt";
+	double threshold = 1.0;
+	bool update = false;
+	char const* firmware = nullptr;
+};
+
+struct Result {
+	std::string name;
+	avr_cycle_count_t cycles;
+};
+
+struct Run {
+	std::vector<Result> results;
+	std::string name;
+	avr_cycle_count_t start = 0;
+	bool running = false;
+	bool done = false;
+	bool broken = false;
+};
+
+// The benchmark's name, a string in flash at the address in GPIOR1/GPIOR2
+auto read_name(avr_t* avr) -> std::string {
+	auto address = avr->data[GPIOR1] | avr->data[GPIOR2] << 8;
+	auto name = std::string{};
+	while (address <= static_cast<int>(avr->flashend) && avr->flash[address] &&
+		   name.size() < 80)
+		name += static_cast<char>(avr->flash[address++]);
+	return name;
+}
+
+auto on_mark(avr_t* avr, avr_io_addr_t addr, uint8_t v, void* param) -> void {
+	auto& run = *static_cast<Run*>(param);
+	// A callback replaces the write, the register keeps what it was given
+	avr->data[addr] = v;
+
+	switch (v) {
+	case MARK_START:
+		run.name = read_name(avr);
+		run.start = avr->cycle;
+		run.running = true;
+		break;
+	case MARK_STOP:
+		if (!run.running) {
+			fprintf(stderr, "avrbench: stop without a start\n");
+			run.broken = true;
+			break;
+		}
+		run.results.push_back({run.name, avr->cycle - run.start});
+		run.running = false;
+		break;
+	case MARK_DONE: run.done = true; break;
+	default:
+		fprintf(stderr, "avrbench: unknown mark %u\n", v);
+		run.broken = true;
+		break;
+	}
+}
+
+// The UARTs would echo the firmware's log and the display commands
+auto quiet_uart(avr_t* avr, char name) -> void {
+	auto flags = uint32_t{0};
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS(name), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS(name), &flags);
+}
+
+auto simulate(char const* path, Run& run) -> bool {
+	auto firmware = elf_firmware_t{};
+	if (elf_read_firmware(path, &firmware) != 0) {
+		fprintf(stderr, "avrbench: cannot read %s\n", path);
+		return false;
+	}
+	if (!firmware.mmcu[0])
+		strcpy(firmware.mmcu, "atmega2560");
+	if (!firmware.frequency)
+		firmware.frequency = 16000000;
+
+	auto* avr = avr_make_mcu_by_name(firmware.mmcu);
+	if (!avr) {
+		fprintf(stderr, "avrbench: simavr has no %s\n", firmware.mmcu);
+		return false;
+	}
+	avr_init(avr);
+	avr->log = LOG_ERROR;
+	avr_load_firmware(avr, &firmware);
+	quiet_uart(avr, '0');
+	quiet_uart(avr, '3');
+	avr_register_io_write(avr, GPIOR0, on_mark, &run);
+
+	auto state = static_cast<int>(cpu_Running);
+	while (!run.done && !run.broken && state != cpu_Done &&
+		   state != cpu_Crashed && avr->cycle < CYCLE_LIMIT)
+		state = avr_run(avr);
+
+	if (state == cpu_Crashed)
+		fprintf(stderr, "avrbench: the firmware crashed\n");
+	else if (!run.done && !run.broken)
+		fprintf(stderr, "avrbench: the firmware never finished\n");
+	return run.done && !run.broken;
+}
+
+auto read_baseline(char const* path, std::map<std::string, long>& baseline)
+	-> bool {
+	auto in = std::ifstream{path};
+	if (!in)
+		return false;
+	for (auto line = std::string{}; std::getline(in, line);) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		char* rest = nullptr;
+		auto const cycles = strtol(line.c_str(), &rest, 10);
+		while (*rest == ' ' || *rest == '\t')
+			++rest;
+		if (*rest)
+			baseline[rest] = cycles;
+	}
+	return true;
+}
+
+auto write_baseline(char const* path, std::vector<Result> const& results)
+	-> bool {
+	auto* f = fopen(path, "w");
+	if (!f)
+		return false;
+	fprintf(f,
+			"# CPU cycles per benchmark under simavr, see bench/Bench.h.\n"
+			"# Written by `make bench-baseline`, `make bench` fails when a\n"
+			"# count grows past the threshold.\n"
+			"# Lines are \"<cycles> <name>\".\n");
+	for (auto const& r : results)
+		fprintf(f, "%llu %s\n", static_cast<unsigned long long>(r.cycles),
+				r.name.c_str());
+	return fclose(f) == 0;
+}
+
+// Counts less what the marks cost, the empty benchmark left out
+auto net_counts(std::vector<Result> const& raw) -> std::vector<Result> {
+	auto overhead = avr_cycle_count_t{0};
+	for (auto const& r : raw) {
+		if (r.name == EMPTY)
+			overhead = r.cycles;
+	}
+	auto results = std::vector<Result>{};
+	for (auto const& r : raw) {
+		if (r.name != EMPTY)
+			results.push_back({r.name, r.cycles - overhead});
+	}
+	return results;
+}
+
+// True when nothing regressed
+auto compare(std::vector<Result> const& results,
+			 std::map<std::string, long> baseline,
+			 double threshold) -> bool {
+	auto ok = true;
+	printf("%10s %10s %8s  %s\n", "cycles", "baseline", "change", "benchmark");
+	for (auto const& r : results) {
+		auto const it = baseline.find(r.name);
+		if (it == baseline.end()) {
+			printf("%10llu %10s %8s  %s (new)\n",
+				   static_cast<unsigned long long>(r.cycles), "-", "-",
+				   r.name.c_str());
+			continue;
+		}
+		auto const base = it->second;
+		baseline.erase(it);
+		auto const change =
+			base ? (static_cast<double>(r.cycles) - base) * 100.0 / base : 0.0;
+		auto const regressed = change > threshold;
+		ok = ok && !regressed;
+		printf("%10llu %10ld %+7.1f%%  %s%s\n",
+			   static_cast<unsigned long long>(r.cycles), base, change,
+			   r.name.c_str(), regressed ? "  REGRESSION" : "");
+	}
+	for (auto const& [name, cycles] : baseline)
+		printf("%10s %10ld %8s  %s (gone)\n", "-", cycles, "-", name.c_str());
+	return ok;
+}
+
+// Writes `results` as the new baseline and shows them
+auto record(char const* path, std::vector<Result> const& results) -> int {
+	if (!write_baseline(path, results)) {
+		fprintf(stderr, "avrbench: cannot write %s\n", path);
+		return 2;
+	}
+	for (auto const& r : results)
+		printf("%10llu  %s\n", static_cast<unsigned long long>(r.cycles),
+			   r.name.c_str());
+	return 0;
+}
+
+auto parse(int argc, char** argv, Options& o) -> bool {
+	for (int c; (c = getopt(argc, argv, "b:t:u")) != -1;) {
+		switch (c) {
+		case 'b': o.baseline = optarg; break;
+		case 't': o.threshold = atof(optarg); break;
+		case 'u': o.update = true; break;
+		default: return false;
+		}
+	}
+	if (optind != argc - 1)
+		return false;
+	o.firmware = argv[optind];
+	return true;
+}
+
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+	auto options = Options{};
+	if (!parse(argc, argv, options)) {
+		fprintf(stderr,
+				"usage: %s [-b BASELINE] [-t PERCENT] [-u] FIRMWARE.elf\n",
+				argv[0]);
+		return 2;
+	}
+
+	auto run = Run{};
+	if (!simulate(options.firmware, run))
+		return 2;
+	auto const results = net_counts(run.results);
+
+	if (options.update)
+		return record(options.baseline, results);
+
+	auto baseline = std::map<std::string, long>{};
+	if (!read_baseline(options.baseline, baseline)) {
+		fprintf(stderr, "avrbench: cannot read %s\n", options.baseline);
+		return 2;
+	}
+	if (baseline.empty()) {
+		printf("No counts in %s yet, recording these, commit them\n",
+			   options.baseline);
+		return record(options.baseline, results);
+	}
+	if (!compare(results, baseline, options.threshold)) {
+		printf("Slower than the baseline by more than %.1f%%\n",
+			   options.threshold);
+		return 1;
+	}
+	return 0;
+}
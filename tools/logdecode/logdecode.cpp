@@ -0,0 +1,292 @@
+// Turns a KEV_LOG_TOKENIZED log stream back into the text the firmware would
+// have printed. The token dictionary is rebuilt from the firmware sources:
+// every string literal in them is hashed the same way TOK() does.
+//
+//   logdecode [-p DEVICE] [-b BAUD] SOURCE...
+//
+// Reads DEVICE (set to raw mode at BAUD, default 115200) or stdin.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include "Token.h"
+
+using kev::LogTag;
+
+namespace {
+
+using Dictionary = std::map<uint16_t, std::string>;
+
+auto read_file(char const* path) -> std::string {
+	auto in = std::ifstream{path, std::ios::binary};
+	auto ss = std::stringstream{};
+	ss << in.rdbuf();
+	return ss.str();
+}
+
+auto hex_value(char c) -> int {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// Parses the literal starting at src[i] (the opening quote), appending its
+// bytes to out. Returns the index past the closing quote.
+auto parse_literal(std::string const& src, size_t i, std::string& out)
+	-> size_t {
+	for (++i; i < src.size() && src[i] != '"'; ++i) {
+		if (src[i] != '\\') {
+			out += src[i];
+			continue;
+		}
+		auto const c = src[++i];
+		if (c >= '0' && c <= '7') {
+			auto v = 0;
+			for (auto n = 0; n < 3 && src[i] >= '0' && src[i] <= '7'; ++n)
+				v = v * 8 + (src[i++] - '0');
+			out += static_cast<char>(v);
+			--i;
+			continue;
+		}
+		switch (c) {
+		case 'n': out += '\n'; break;
+		case 't': out += '\t'; break;
+		case 'r': out += '\r'; break;
+		case 'x': {
+			auto v = 0;
+			while (hex_value(src[i + 1]) >= 0)
+				v = v * 16 + hex_value(src[++i]);
+			out += static_cast<char>(v);
+		}; break;
+		default: out += c; break;
+		}
+	}
+	return i + 1;
+}
+
+auto skip_blank(std::string const& src, size_t i) -> size_t {
+	while (i < src.size()) {
+		if (isspace(static_cast<unsigned char>(src[i]))) {
+			++i;
+		} else if (src.compare(i, 2, "//") == 0) {
+			i = src.find('\n', i);
+		} else if (src.compare(i, 2, "/*") == 0) {
+			i = src.find("*/", i);
+			i = i == std::string::npos ? i : i + 2;
+		} else {
+			break;
+		}
+	}
+	return i;
+}
+
+auto add_literals(std::string const& src, Dictionary& dict) -> void {
+	for (size_t i = 0; i < src.size();) {
+		if (src.compare(i, 2, "//") == 0 || src.compare(i, 2, "/*") == 0) {
+			i = skip_blank(src, i);
+			continue;
+		}
+		if (src[i] == '\'') {
+			i = src.find('\'', i + (src[i + 1] == '\\' ? 3 : 2)) + 1;
+			continue;
+		}
+		if (src[i] != '"') {
+			++i;
+			continue;
+		}
+
+		// Adjacent literals are one string to the compiler
+		auto text = std::string{};
+		i = parse_literal(src, i, text);
+		for (auto next = skip_blank(src, i);
+			 next < src.size() && src[next] == '"';
+			 next = skip_blank(src, i)) {
+			i = parse_literal(src, next, text);
+		}
+
+		auto const id = kev::token_id(text.c_str());
+		auto const [it, inserted] = dict.emplace(id, text);
+		if (!inserted && it->second != text) {
+			fprintf(stderr,
+					"logdecode: token %04x collides: \"%s\" / \"%s\"\n", id,
+					it->second.c_str(), text.c_str());
+		}
+	}
+}
+
+auto open_port(char const* path, speed_t baud) -> int {
+	auto const fd = open(path, O_RDONLY | O_NOCTTY);
+	if (fd < 0)
+		return fd;
+	termios tio{};
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		cfsetspeed(&tio, baud);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+auto baud_rate(long baud) -> speed_t {
+	switch (baud) {
+	case 9600: return B9600;
+	case 57600: return B57600;
+	case 230400: return B230400;
+	default: return B115200;
+	}
+}
+
+struct Input {
+	int fd;
+
+	// -1 at end of input
+	auto next() -> int {
+		uint8_t b;
+		return ::read(fd, &b, 1) == 1 ? b : -1;
+	}
+
+	auto varint(unsigned long& v) -> bool {
+		v = 0;
+		for (auto shift = 0; shift < 35; shift += 7) {
+			auto const b = next();
+			if (b < 0)
+				return false;
+			v |= static_cast<unsigned long>(b & 0x7F) << shift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	auto u16(uint16_t& v) -> bool {
+		auto const lo = next();
+		auto const hi = next();
+		v = static_cast<uint16_t>(lo | (hi << 8));
+		return lo >= 0 && hi >= 0;
+	}
+};
+
+auto lookup(Dictionary const& dict, uint16_t id) -> std::string {
+	auto const it = dict.find(id);
+	if (it != dict.end())
+		return it->second;
+	char buf[16];
+	snprintf(buf, sizeof(buf), "<#%04x>", id);
+	return buf;
+}
+
+// Decodes the rest of a frame after FRAME_START. False when it is malformed.
+auto decode_frame(Input& in, Dictionary const& dict, std::string& out)
+	-> bool {
+	auto name = uint16_t{};
+	if (!in.u16(name))
+		return false;
+	out += "[" + lookup(dict, name) + "] ";
+
+	for (;;) {
+		auto const tag = in.next();
+		auto v = 0ul;
+		auto id = uint16_t{};
+		switch (static_cast<LogTag>(tag)) {
+		case LogTag::END: out += '\n'; return true;
+		case LogTag::TOKEN: {
+			if (!in.u16(id))
+				return false;
+			out += lookup(dict, id);
+		}; break;
+		case LogTag::INT: {
+			if (!in.varint(v))
+				return false;
+			auto const n =
+				static_cast<long>(v >> 1) ^ -static_cast<long>(v & 1);
+			out += std::to_string(n);
+		}; break;
+		case LogTag::UINT: {
+			if (!in.varint(v))
+				return false;
+			out += std::to_string(v);
+		}; break;
+		case LogTag::UINT_HEX: {
+			if (!in.varint(v))
+				return false;
+			char buf[16];
+			snprintf(buf, sizeof(buf), "%lX", v);
+			out += buf;
+		}; break;
+		case LogTag::STRING: {
+			auto const len = in.next();
+			if (len < 0)
+				return false;
+			for (auto n = 0; n < len; ++n) {
+				auto const c = in.next();
+				if (c < 0)
+					return false;
+				out += static_cast<char>(c);
+			}
+		}; break;
+		case LogTag::CHAR: {
+			auto const c = in.next();
+			if (c < 0)
+				return false;
+			out += static_cast<char>(c);
+		}; break;
+		case LogTag::FRAME_START:
+		default: return false;
+		}
+	}
+}
+
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+	auto dict = Dictionary{};
+	char const* port = nullptr;
+	auto baud = 115200l;
+
+	for (auto i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+			port = argv[++i];
+		} else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			baud = strtol(argv[++i], nullptr, 10);
+		} else {
+			add_literals(read_file(argv[i]), dict);
+		}
+	}
+	if (dict.empty()) {
+		fprintf(stderr, "usage: %s [-p DEVICE] [-b BAUD] SOURCE...\n",
+				argv[0]);
+		return 2;
+	}
+
+	auto in = Input{port ? open_port(port, baud_rate(baud)) : STDIN_FILENO};
+	if (in.fd < 0) {
+		perror(port);
+		return 1;
+	}
+
+	// Plain text (boot messages, blank lines) passes through untouched
+	for (auto b = in.next(); b >= 0; b = in.next()) {
+		if (b != static_cast<int>(LogTag::FRAME_START)) {
+			putchar(b);
+			fflush(stdout);
+			continue;
+		}
+
+		auto text = std::string{};
+		if (!decode_frame(in, dict, text))
+			text += "<malformed log frame>\n";
+		fputs(text.c_str(), stdout);
+		fflush(stdout);
+	}
+}
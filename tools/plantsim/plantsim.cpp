@@ -0,0 +1,537 @@
+// Runs the tank and aqueduct state machines from src/ against a model of the
+// plant: tank and cistern volumes, pump and valve flows, the level sensors,
+// and an operator who answers every prompt after the same delay. Virtual
+// time jumps straight to whatever happens next (a firmware deadline, a level
+// reaching a sensor, the operator), so a day of production takes
+// milliseconds. Use it to compare control changes before they reach the
+// plant.
+//
+//   plantsim [-d HOURS] [-r MINUTES] [-p] [-v]
+//
+// -d  how long to run, 24 h by default
+// -r  operator response time, 2 min by default
+// -p  tanks fill at the same time and split the pump flow, the way the
+//     plant ran before the fill line
+// -v  print the firmware log as it goes
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "AqueductSM.h"
+#include "Arbiter.h"
+#include "InputDebouncer.h"
+#include "NativeHal.h"
+#include "SharedOutput.h"
+#include "Switch.h"
+#include "TankSM.h"
+#include "Tanks.h"
+#include "Timer.h"
+
+namespace {
+
+using kev::Switch;
+
+// Same tanks as main.cpp
+constexpr kev::TankInfo tank_infos[] PROGMEM = {
+	{"Tanque 3", 3500, 'a', 1},
+	{"Tanque 4", 2000, 'b', 2},
+};
+constexpr uint8_t TANKS = sizeof(tank_infos) / sizeof(tank_infos[0]);
+
+// Rough figures in litres per minute, edit them to match the plant
+constexpr auto FILL_LPM = 180.0;
+constexpr auto PROCESS_LPM = 60.0;
+constexpr auto AQ_VALVE_LPM = 150.0;
+constexpr auto AQ_PUMP_LPM = 150.0;
+
+constexpr auto CISTERN_L = 20000.0;
+// Where the level sensors sit, as a fraction of the vessel
+constexpr auto TANK_SENSOR_HI = 0.95;
+constexpr auto CISTERN_SENSOR_HI = 0.9;
+constexpr auto CISTERN_SENSOR_LO = 0.2;
+// Wired as on the plant, see main.cpp
+constexpr uint8_t TANK_SENSOR_HI_PINS[TANKS] = {22, 24};
+constexpr uint8_t AQ_SENSOR_HI_PIN = 26;
+constexpr uint8_t AQ_SENSOR_LO_PIN = 32;
+
+constexpr auto MS_PER_MIN = 60000.0;
+constexpr uint8_t TANK_STATES = static_cast<uint8_t>(TankState::LAST);
+
+struct Options {
+	unsigned long duration_ms = 24 * 60 * 60000ul;
+	unsigned long response_ms = 2 * 60000ul;
+	bool serial_fills = true;
+	bool verbose = false;
+};
+
+// True while the water is at or above it. The firmware reads it on a native
+// pin, low while wet like the plant's sensors.
+struct Sensor {
+	auto set(bool level) -> void {
+		wet = level;
+		native::set_pin_level(pin, !wet);
+	}
+
+	uint8_t pin = 0;
+	bool wet = false;
+};
+
+// Minutes until `volume`, changing at `rate` per minute, reaches `level`.
+// INFINITY when it never does.
+auto minutes_to(double volume, double rate, double level) -> double {
+	if ((rate > 0 && volume < level) || (rate < 0 && volume > level))
+		return (level - volume) / rate;
+	return INFINITY;
+}
+
+auto clamp(double v, double lo, double hi) -> double {
+	return v < lo ? lo : v > hi ? hi : v;
+}
+
+// The operator is needed from `since`, and acts once the response time
+// has gone by
+struct Prompt {
+	auto update(bool needed, unsigned long now) -> void {
+		if (needed && !pending)
+			since = now;
+		pending = needed;
+	}
+
+	[[nodiscard]] auto due(Options const& o) const -> unsigned long {
+		return pending ? since + o.response_ms : ~0ul;
+	}
+
+	bool pending = false;
+	unsigned long since = 0;
+};
+
+// One tank's water, and what happened to it
+struct TankModel {
+	double capacity_l = 0;
+	double volume_l = 0;
+
+	Switch recir_pump;
+	Switch ingress_valve;
+	Switch process_valve;
+	Sensor sensor_hi;
+
+	// As of the last tick
+	TankState state = TankState::INITIAL;
+	// Back in WAITING_CHEM_2 once CHEM_2 ran its time, where the operator
+	// moves the tank on with "force next" instead of dosing again
+	bool dosed = false;
+	Prompt prompt;
+
+	unsigned long state_ms[TANK_STATES] = {};
+	// Ready for the pump or the process line, behind another tank
+	unsigned long queued_fill_ms = 0;
+	unsigned long queued_process_ms = 0;
+	unsigned batches = 0;
+	unsigned failsafes = 0;
+	double treated_l = 0;
+};
+
+using FillPump = SharedOutput<Switch, TANKS>;
+
+using Aqueduct = AqueductSM<Switch, Switch>;
+
+// Water moving right now, in litres per minute
+struct Flows {
+	double tank_in[TANKS] = {};
+	double tank_out[TANKS] = {};
+	double cistern_in = 0;
+	double cistern_out = 0;
+	uint8_t filling = 0;
+};
+
+struct Plant {
+	explicit Plant(bool serial_fills) : serial_fills{serial_fills} {
+		for (uint8_t i = 0; i < TANKS; ++i) {
+			models[i].capacity_l = tanks.info(i).capacity_l;
+			models[i].sensor_hi.pin = TANK_SENSOR_HI_PINS[i];
+		}
+	}
+
+	auto deadline(Timestamp now) -> Timestamp {
+		return kev::earliest(now, tanks.next_deadline(now),
+							 aqueduct.next_deadline(now));
+	}
+
+	// The sensors see the water where advance() left it. The debouncer
+	// first takes the samples it would have taken since the last look, on
+	// the levels from then; they only matter while some input is settling,
+	// otherwise they are skipped.
+	auto sense(unsigned long now) -> void {
+		auto const due = now * 1000ull / kev::InputDebouncer::SAMPLE_PERIOD_US;
+		while (sampled < due && sensors.settling()) {
+			sensors.sample();
+			++sampled;
+		}
+		sampled = due;
+
+		for (auto& m : models)
+			m.sensor_hi.set(m.volume_l >= m.capacity_l * TANK_SENSOR_HI);
+		aq_sensor_hi.set(cistern_l >= CISTERN_L * CISTERN_SENSOR_HI);
+		aq_sensor_lo.set(cistern_l >= CISTERN_L * CISTERN_SENSOR_LO);
+	}
+
+	// Whatever the operator was asked for and had time to do
+	auto operate(unsigned long now, Options const& o) -> void {
+		tanks.for_each([&](uint8_t i, auto& sm) {
+			auto& m = models[i];
+			if (m.prompt.due(o) > now)
+				return;
+			m.prompt.pending = false;
+			if (m.dosed)
+				sm.event_force_next_stage();
+			else
+				sm.event_next();
+		});
+		if (aq_prompt.due(o) <= now) {
+			aq_prompt.pending = false;
+			if (aqueduct.get_state() == AqState::STOPPED)
+				aqueduct.event_valve_on();
+			else
+				aqueduct.event_pump_on();
+		}
+	}
+
+	auto tick(Timestamp now) -> void {
+		// Entry actions and handovers take one more pass each
+		for (uint8_t pass = 0; pass < 4; ++pass) {
+			tanks.for_each([&](uint8_t, auto& sm) { sm.tick(now); });
+			aqueduct.tick(now);
+			if ((deadline(now) - now).unsafeGetValue() > 0)
+				return;
+		}
+	}
+
+	// Notes state changes and what now needs the operator
+	auto observe(unsigned long now) -> void {
+		tanks.for_each([&](uint8_t i, auto& sm) {
+			auto& m = models[i];
+			auto const state = sm.get_state();
+			if (state != m.state) {
+				if (m.state == TankState::IN_PROCESS)
+					++m.batches;
+				if (m.state == TankState::FILLING && !m.sensor_hi.wet)
+					++m.failsafes;
+				m.dosed = m.state == TankState::CHEM_2 &&
+						  state == TankState::WAITING_CHEM_2;
+				m.state = state;
+			}
+			m.prompt.update(needs_operator(sm, m), now);
+		});
+
+		auto const aq = aqueduct.get_state();
+		aq_prompt.update((aq == AqState::STOPPED && !aq_sensor_lo.wet) ||
+							 (aq == AqState::FILLING && cistern_l <= 0),
+						 now);
+	}
+
+	auto flows() const -> Flows {
+		auto f = Flows{};
+		for (auto const& m : models)
+			f.filling += m.ingress_valve ? 1 : 0;
+		auto const pumping = fill_pump && f.filling && cistern_l > 0;
+		for (uint8_t i = 0; i < TANKS; ++i) {
+			auto const& m = models[i];
+			if (pumping && m.ingress_valve)
+				f.tank_in[i] = FILL_LPM / f.filling;
+			if (m.process_valve && m.volume_l > 0)
+				f.tank_out[i] = PROCESS_LPM;
+		}
+		if (aq_valve)
+			f.cistern_in = AQ_VALVE_LPM + (aq_pump ? AQ_PUMP_LPM : 0);
+		f.cistern_out = pumping ? FILL_LPM : 0;
+		return f;
+	}
+
+	// Whichever comes first: a firmware deadline, a level reaching a sensor,
+	// the next debouncer sample while an input settles, or the operator
+	auto next_event(unsigned long now, Options const& o) -> unsigned long {
+		auto next = deadline(now).unsafeGetValue();
+		auto sooner = [&](unsigned long at) { next = at < next ? at : next; };
+		sooner(next_crossing(now));
+		if (sensors.settling())
+			sooner(static_cast<unsigned long>(
+				((sampled + 1) * kev::InputDebouncer::SAMPLE_PERIOD_US + 999) /
+				1000));
+		for (auto const& m : models)
+			sooner(m.prompt.due(o));
+		sooner(aq_prompt.due(o));
+		return next > now ? next : now + 1;
+	}
+
+	// When some level next reaches a sensor or runs out
+	auto next_crossing(unsigned long now) const -> unsigned long {
+		auto const f = flows();
+		auto minutes = double{INFINITY};
+		auto earliest = [&](double m) { minutes = m < minutes ? m : minutes; };
+
+		for (uint8_t i = 0; i < TANKS; ++i) {
+			auto const& m = models[i];
+			auto const rate = f.tank_in[i] - f.tank_out[i];
+			earliest(minutes_to(m.volume_l, rate,
+								m.capacity_l * TANK_SENSOR_HI));
+			earliest(minutes_to(m.volume_l, rate, 0));
+		}
+		auto const rate = f.cistern_in - f.cistern_out;
+		earliest(minutes_to(cistern_l, rate, CISTERN_L * CISTERN_SENSOR_HI));
+		earliest(minutes_to(cistern_l, rate, CISTERN_L * CISTERN_SENSOR_LO));
+		earliest(minutes_to(cistern_l, rate, 0));
+
+		if (isinf(minutes))
+			return ~0ul;
+		return now + static_cast<unsigned long>(ceil(minutes * MS_PER_MIN));
+	}
+
+	// Moves the water `ms` ahead with the outputs as they are, and counts
+	// the time
+	auto advance(unsigned long ms) -> void {
+		auto const f = flows();
+		auto const minutes = ms / MS_PER_MIN;
+		auto busy = false;
+
+		for (uint8_t i = 0; i < TANKS; ++i) {
+			auto& m = models[i];
+			auto const volume = m.volume_l +
+								(f.tank_in[i] - f.tank_out[i]) * minutes;
+			m.volume_l = clamp(volume, 0, m.capacity_l);
+			m.treated_l += f.tank_out[i] * minutes;
+			busy = busy || f.tank_out[i] > 0;
+
+			m.state_ms[static_cast<uint8_t>(m.state)] += ms;
+			if (m.state == TankState::INITIAL && queued(fill_position(i)))
+				m.queued_fill_ms += ms;
+			if (m.state == TankState::WAITING_IN_PROCESS &&
+				queued(in_process_position(i)))
+				m.queued_process_ms += ms;
+		}
+		cistern_l = clamp(cistern_l + (f.cistern_in - f.cistern_out) * minutes,
+						  0, CISTERN_L);
+		cistern_min_l = cistern_l < cistern_min_l ? cistern_l : cistern_min_l;
+
+		process_busy_ms += busy ? ms : 0;
+		fill_pump_ms += fill_pump ? ms : 0;
+		fill_pump_split_ms += f.cistern_out > 0 && f.filling > 1 ? ms : 0;
+		fill_pump_dry_ms += fill_pump && cistern_l <= 0 ? ms : 0;
+		aq_valve_ms += aq_valve ? ms : 0;
+		aq_pump_ms += aq_pump ? ms : 0;
+	}
+
+	bool const serial_fills;
+
+	TankModel models[TANKS];
+	double cistern_l = CISTERN_L * CISTERN_SENSOR_HI;
+	double cistern_min_l = cistern_l;
+
+	unsigned long process_busy_ms = 0;
+	unsigned long fill_pump_ms = 0;
+	unsigned long fill_pump_split_ms = 0;
+	unsigned long fill_pump_dry_ms = 0;
+	unsigned long aq_valve_ms = 0;
+	unsigned long aq_pump_ms = 0;
+
+	Switch fill_pump;
+	FillPump fill_pump_shared{fill_pump};
+	FillPump::Handle<0> fill_pump_a = fill_pump_shared.handle<0>();
+	FillPump::Handle<1> fill_pump_b = fill_pump_shared.handle<1>();
+	// Without serial fills every tank gets a line of its own
+	kev::Arbiter fill_lines[TANKS];
+	kev::Arbiter in_process_line;
+
+	// Sampled in sense(), there is no timer interrupt here
+	kev::InputDebouncer sensors{5_s};
+	unsigned long long sampled = 0;
+
+	Switch aq_valve;
+	Switch aq_pump;
+	Sensor aq_sensor_hi{AQ_SENSOR_HI_PIN};
+	Sensor aq_sensor_lo{AQ_SENSOR_LO_PIN};
+	Prompt aq_prompt;
+
+	TankSM tank_a{TOK("tank_a"),
+				  fill_pump_a,
+				  models[0].recir_pump,
+				  models[0].ingress_valve,
+				  models[0].process_valve,
+				  kev::DebouncedInput{sensors, TANK_SENSOR_HI_PINS[0], true},
+				  kev::DebouncedInput{sensors, AQ_SENSOR_LO_PIN, true},
+				  fill_line(0),
+				  in_process_line.handle(0)};
+	TankSM tank_b{TOK("tank_b"),
+				  fill_pump_b,
+				  models[1].recir_pump,
+				  models[1].ingress_valve,
+				  models[1].process_valve,
+				  kev::DebouncedInput{sensors, TANK_SENSOR_HI_PINS[1], true},
+				  kev::DebouncedInput{sensors, AQ_SENSOR_LO_PIN, true},
+				  fill_line(1),
+				  in_process_line.handle(1)};
+	kev::Tanks<TankSM, TankSM> tanks{tank_infos, tank_a, tank_b};
+	Aqueduct aqueduct{aq_valve, aq_pump,
+					  kev::DebouncedInput{sensors, AQ_SENSOR_HI_PIN, true}};
+
+   private:
+	auto fill_line(uint8_t i) -> kev::Arbiter::Handle {
+		return fill_lines[serial_fills ? 0 : i].handle(i);
+	}
+
+	auto fill_position(uint8_t i) -> uint8_t {
+		return tanks.visit(i, [](auto& sm) { return sm.fill_position(); });
+	}
+
+	auto in_process_position(uint8_t i) -> uint8_t {
+		return tanks.visit(i,
+						   [](auto& sm) { return sm.in_process_position(); });
+	}
+
+	static auto queued(uint8_t position) -> bool {
+		return position != kev::Arbiter::NONE && position > 0;
+	}
+
+	// What an operator watching the display would confirm next. Tanks in
+	// line move on by themselves.
+	template <class TankSMT>
+	static auto needs_operator(TankSMT& sm, TankModel const& m) -> bool {
+		switch (sm.get_state()) {
+		case TankState::INITIAL:
+			return sm.fill_position() == kev::Arbiter::NONE;
+		case TankState::WAITING_CHEM_1:
+		case TankState::WAITING_CHEM_2: return true;
+		case TankState::WAITING_IN_PROCESS:
+			return sm.in_process_position() == kev::Arbiter::NONE;
+		case TankState::IN_PROCESS: return m.volume_l <= 0;
+		default: return false;
+		}
+	}
+};
+
+auto wall_ms() -> double {
+	timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+auto percent(unsigned long part, unsigned long whole) -> double {
+	return whole ? 100.0 * part / whole : 0;
+}
+
+auto hours(unsigned long ms) -> double { return ms / 3600000.0; }
+
+auto stdout_sink(void*, uint8_t const* data, uint32_t len) -> void {
+	fwrite(data, 1, len, stdout);
+}
+
+auto print_clock(unsigned long ms) -> void {
+	auto const s = ms / 1000;
+	printf("[plantsim] %02lu:%02lu:%02lu\n", s / 3600, s / 60 % 60, s % 60);
+}
+
+auto report(Plant const& p, Options const& o, unsigned long steps,
+			double wall) -> void {
+	auto const total = o.duration_ms;
+	printf("Simulated %.1f h in %.1f ms, %lu steps. %s, operator answers in "
+		   "%lu min.\n\n",
+		   hours(total), wall, steps,
+		   o.serial_fills ? "Tanks fill one at a time"
+						  : "Tanks fill together",
+		   o.response_ms / 60000);
+
+	auto batches = 0u;
+	auto treated = 0.0;
+	for (auto const& m : p.models) {
+		batches += m.batches;
+		treated += m.treated_l;
+	}
+	printf("Process line  %u batches, %.0f L treated, %.1f L/h\n", batches,
+		   treated, treated / hours(total));
+	printf("              busy %.1f %%, idle %.2f h\n",
+		   percent(p.process_busy_ms, total),
+		   hours(total - p.process_busy_ms));
+	printf("Fill pump     on %.1f %%, split between tanks %.1f %%, "
+		   "dry %.1f %%\n",
+		   percent(p.fill_pump_ms, total),
+		   percent(p.fill_pump_split_ms, total),
+		   percent(p.fill_pump_dry_ms, total));
+	printf("Aqueduct      valve %.1f %%, pump %.1f %%, cistern down to "
+		   "%.0f L\n",
+		   percent(p.aq_valve_ms, total), percent(p.aq_pump_ms, total),
+		   p.cistern_min_l);
+
+	for (uint8_t i = 0; i < TANKS; ++i) {
+		auto const& m = p.models[i];
+		auto const info = p.tanks.info(i);
+		printf("\n%s (%u L)  %u batches, %.0f L, %u fills cut by the "
+			   "failsafe\n",
+			   info.name, info.capacity_l, m.batches, m.treated_l,
+			   m.failsafes);
+		printf("  waited %.2f h for the pump, %.2f h for the process line\n",
+			   hours(m.queued_fill_ms), hours(m.queued_process_ms));
+		for (uint8_t s = 0; s < TANK_STATES; ++s) {
+			auto const name =
+				decltype(p.tank_a)::Fsm::name(static_cast<TankState>(s));
+			printf("  %-20s %5.2f h\n", kev::flash_chars(name),
+				   hours(m.state_ms[s]));
+		}
+	}
+}
+
+auto parse(int argc, char** argv, Options& o) -> bool {
+	for (int c; (c = getopt(argc, argv, "d:r:pv")) != -1;) {
+		switch (c) {
+		case 'd': o.duration_ms = atof(optarg) * 3600000.0; break;
+		case 'r': o.response_ms = atof(optarg) * MS_PER_MIN; break;
+		case 'p': o.serial_fills = false; break;
+		case 'v': o.verbose = true; break;
+		default: return false;
+		}
+	}
+	return optind == argc && o.duration_ms > 0;
+}
+
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+	auto options = Options{};
+	if (!parse(argc, argv, options)) {
+		fprintf(stderr,
+				"usage: %s [-d HOURS] [-r MINUTES] [-p] [-v]\n", argv[0]);
+		return 2;
+	}
+	if (options.verbose)
+		native::set_tx_sink(Serial, stdout_sink, nullptr);
+	native::use_virtual_time();
+
+	auto const started = wall_ms();
+	auto plant = Plant{options.serial_fills};
+	auto const end = options.duration_ms;
+	unsigned long now = 0;
+	unsigned long steps = 0;
+	while (now < end) {
+		native::set_time_us(now * 1000ull);
+		plant.sense(now);
+		plant.operate(now, options);
+		plant.tick(now);
+		plant.observe(now);
+
+		if (kev::log_buffer.pending()) {
+			if (options.verbose)
+				print_clock(now);
+			kev::log_buffer.drain(Serial);
+		}
+
+		auto next = plant.next_event(now, options);
+		next = next < end ? next : end;
+
+		plant.advance(next - now);
+		now = next;
+		++steps;
+	}
+
+	report(plant, options, steps, wall_ms() - started);
+	return 0;
+}
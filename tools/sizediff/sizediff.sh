@@ -0,0 +1,128 @@
+#!/bin/sh
+# Flash and static RAM of the Mega2560 firmware at two commits, and the
+# change between them:
+#
+#   tools/sizediff/sizediff.sh BEFORE [AFTER]
+#
+# AFTER is HEAD by default. Each commit is built with PlatformIO in a
+# worktree of its own under .pio/sizediff, removed again on exit; the
+# working tree is left alone (and so are changes not yet committed). A
+# build that fails stops the script. Flash is .text + .data, static RAM
+# is .data + .bss, see `make size`. AVR_SIZE overrides the avr-size of
+# PlatformIO's AVR toolchain.
+#
+# When both commits have the benchmarks (bench/Benchmarks.h), their cycle
+# counts under simavr follow, see `make bench`.
+
+set -e
+
+if [ $# -lt 1 ]; then
+	echo "usage: $0 BEFORE [AFTER]" >&2
+	exit 2
+fi
+before=$1
+after=${2:-HEAD}
+
+root=$(git rev-parse --show-toplevel)
+size=${AVR_SIZE:-$HOME/.platformio/packages/toolchain-atmelavr/bin/avr-size}
+[ -x "$size" ] || size=avr-size
+
+fail() {
+	echo "$0: $*" >&2
+	exit 1
+}
+
+for rev in "$before" "$after"; do
+	git -C "$root" rev-parse -q --verify "$rev^{commit}" >/dev/null ||
+		fail "no commit $rev"
+done
+
+cleanup() {
+	for d in "$root"/.pio/sizediff/*; do
+		[ -d "$d" ] || continue
+		git -C "$root" worktree remove --force "$d" || rm -rf "$d"
+	done
+	git -C "$root" worktree prune
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# Checks `rev` out, sets $dir to its worktree
+worktree() {
+	dir=$root/.pio/sizediff/$(git -C "$root" rev-parse --short "$1")
+	[ -d "$dir" ] ||
+		git -C "$root" worktree add -q --detach "$dir" "$1" ||
+		fail "cannot check out $1"
+}
+
+# Builds `rev`, sets $sizes to "text data bss" of its firmware
+measure() {
+	worktree "$1"
+	(cd "$dir" && platformio run -e megaatmega2560 >/dev/null) ||
+		fail "cannot build $1"
+	sizes=$("$size" "$dir/.pio/build/megaatmega2560/firmware.elf" |
+		awk 'NR == 2 { print $1, $2, $3 }')
+	[ -n "$sizes" ] || fail "cannot read the size of $1"
+}
+
+measure "$before"
+before_sizes=$sizes
+measure "$after"
+
+echo "$before_sizes $sizes" |
+	awk -v before="$before" -v after="$after" '
+	function row(name, text, data, bss) {
+		printf "%-12s %8d %8d %8d %8d %8d\n", name, text, data, bss,
+			text + data, data + bss
+	}
+	{
+		printf "%-12s %8s %8s %8s %8s %8s\n", "", "text", "data", "bss",
+			"flash", "ram"
+		row(before, $1, $2, $3)
+		row(after, $4, $5, $6)
+		printf "%-12s %+8d %+8d %+8d %+8d %+8d\n", "change", $4 - $1,
+			$5 - $2, $6 - $3, $4 + $5 - $1 - $2, $5 + $6 - $2 - $3
+	}'
+
+# Runs the benchmarks of `rev`, leaves "<cycles> <name>" lines in
+# $dir/.pio/cycles.txt
+bench() {
+	worktree "$1"
+	(cd "$dir" && platformio run -e bench >/dev/null) ||
+		fail "cannot build the benchmarks of $1"
+	"$root/.pio/avrbench" -u -b "$dir/.pio/cycles.txt" \
+		"$dir/.pio/build/bench/firmware.elf" >/dev/null ||
+		fail "cannot run the benchmarks of $1"
+}
+
+for rev in "$before" "$after"; do
+	worktree "$rev"
+	[ -f "$dir/bench/Benchmarks.h" ] || exit 0
+done
+if ! make -C "$root" -s .pio/avrbench >/dev/null 2>&1; then
+	echo "No cycle counts, avrbench needs libsimavr" >&2
+	exit 0
+fi
+bench "$before"
+before_cycles=$dir/.pio/cycles.txt
+bench "$after"
+
+echo
+awk -v before="$before" -v after="$after" '
+	/^#/ { next }
+	{
+		cycles = $1
+		sub(/^[0-9]+ /, "")
+	}
+	FNR == NR { base[$0] = cycles; next }
+	{
+		if ($0 in base)
+			printf "%10d %10d %+7.1f%%  %s\n", base[$0], cycles,
+				base[$0] ? (cycles - base[$0]) * 100 / base[$0] : 0, $0
+		else
+			printf "%10s %10d %8s  %s\n", "-", cycles, "new", $0
+	}
+	BEGIN {
+		printf "%10s %10s %8s  %s\n", before, after, "change",
+			"benchmark (cycles)"
+	}' "$before_cycles" "$dir/.pio/cycles.txt"